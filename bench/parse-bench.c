@@ -0,0 +1,159 @@
+/*
+ * parse-bench.c -- times rfile_parse() on synthetic listings
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+/* Not built by default; run "make bench/parse-bench" and then
+ * "bench/parse-bench [lines]" (default 1000000). A listing is made up
+ * in each dialect (unix, dos, eplf and mlsd) and parsed line by line
+ * as rdir_parse_data() does, starting with an unknown LIST format.
+ */
+
+#include "syshdr.h"
+#include "ftp.h"
+#include "rfile.h"
+#include "xmalloc.h"
+
+/* called by the reconnect code, which isn't used here */
+void init_ftp(void)
+{
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static const char *months[] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* mostly files, some directories and links, as in a mirror */
+static char *unix_line(unsigned int i)
+{
+	char *s = 0;
+	int r;
+
+	if(i % 10 == 0)
+		r = asprintf(&s, "drwxr-xr-x   2 ftp      ftp          4096 %s %2u  2019 "
+					 "dir-%07u", months[i % 12], i % 28 + 1, i);
+	else if(i % 50 == 1)
+		r = asprintf(&s, "lrwxrwxrwx   1 ftp      ftp            16 %s %2u %02u:%02u "
+					 "link-%07u -> file-%07u.tar.gz", months[i % 12], i % 28 + 1,
+					 i % 24, i % 60, i, i);
+	else
+		r = asprintf(&s, "-rw-r--r--   1 ftp      ftp      %10u %s %2u %02u:%02u "
+					 "file-%07u.tar.gz", i * 37, months[i % 12], i % 28 + 1,
+					 i % 24, i % 60, i);
+	return r == -1 ? 0 : s;
+}
+
+static char *dos_line(unsigned int i)
+{
+	char *s = 0;
+	int r;
+
+	if(i % 10 == 0)
+		r = asprintf(&s, "%02u-%02u-19  %02u:%02uAM       <DIR>          dir-%07u",
+					 i % 12 + 1, i % 28 + 1, i % 12 + 1, i % 60, i);
+	else
+		r = asprintf(&s, "%02u-%02u-26  %02u:%02uPM       %12u file-%07u.zip",
+					 i % 12 + 1, i % 28 + 1, i % 12, i % 60, i * 37, i);
+	return r == -1 ? 0 : s;
+}
+
+static char *eplf_line(unsigned int i)
+{
+	char *s = 0;
+	int r;
+
+	if(i % 10 == 0)
+		r = asprintf(&s, "+i8388621.%u,m%u,/,\tdir-%07u", i, 1500000000u + i, i);
+	else
+		r = asprintf(&s, "+i8388621.%u,m%u,r,s%u,\tfile-%07u.tar.gz", i,
+					 1500000000u + i, i * 37, i);
+	return r == -1 ? 0 : s;
+}
+
+static char *mlsd_line(unsigned int i)
+{
+	char *s = 0;
+	const int r = asprintf(&s, "type=%s;size=%u;modify=2026%02u%02u%02u%02u%02u;"
+						   "UNIX.mode=0%s;UNIX.uid=1000;UNIX.gid=1000; %s-%07u",
+						   i % 10 == 0 ? "dir" : "file", i * 37, i % 12 + 1,
+						   i % 28 + 1, i % 24, i % 60, i % 60,
+						   i % 10 == 0 ? "755" : "644",
+						   i % 10 == 0 ? "dir" : "file", i);
+	return r == -1 ? 0 : s;
+}
+
+typedef struct dialect
+{
+	const char *name;
+	char *(*make_line)(unsigned int i);
+	bool is_mlsd;
+} dialect;
+
+static const dialect dialects[] = {
+	{ "unix", unix_line, false },
+	{ "dos", dos_line, false },
+	{ "eplf", eplf_line, false },
+	{ "mlsd", mlsd_line, true }
+};
+
+int main(int argc, char **argv)
+{
+	const unsigned int n = (argc > 1 ? strtoul(argv[1], 0, 10) : 1000000);
+	if(n == 0) {
+		fprintf(stderr, "usage: %s [lines]\n", argv[0]);
+		return 1;
+	}
+
+	ftp = ftp_create();
+	char **lines = xmalloc(n * sizeof(char *));
+	rfile *f = rfile_create();
+
+	printf("%8s %10s %12s %16s\n", "dialect", "lines", "ms", "ms per 1M lines");
+	for(size_t d = 0; d < sizeof(dialects) / sizeof(dialects[0]); d++) {
+		for(unsigned int i = 0; i < n; i++) {
+			lines[i] = dialects[d].make_line(i);
+			if(!lines[i])
+				return 1;
+		}
+
+		unsigned int failed = 0;
+		ftp->LIST_type = ltUnknown;
+		const double start = now_ms();
+		rfile_parse_begin();
+		for(unsigned int i = 0; i < n; i++) {
+			rfile_clear(f);
+			if(rfile_parse(f, lines[i], "/pub/mirror", dialects[d].is_mlsd) == -1)
+				failed++;
+		}
+		rfile_parse_end();
+		const double ms = now_ms() - start;
+
+		printf("%8s %10u %12.1f %16.1f\n", dialects[d].name, n, ms,
+			   ms * 1e6 / n);
+		if(failed)
+			fprintf(stderr, "%s: %u lines could not be parsed\n",
+					dialects[d].name, failed);
+
+		for(unsigned int i = 0; i < n; i++)
+			free(lines[i]);
+	}
+
+	rfile_destroy(f);
+	free(lines);
+	ftp_destroy(ftp);
+	return 0;
+}
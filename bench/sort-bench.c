@@ -0,0 +1,106 @@
+/*
+ * sort-bench.c -- times list_sort() on synthetic directory listings
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+/* Not built by default; run "make bench/sort-bench" and then
+ * "bench/sort-bench [max entries]" (default 1000000). Listings of 1k,
+ * 10k, ... entries are sorted on path like rdir_sort() does, from a
+ * random order, from the order most servers send, and reversed.
+ */
+
+#include "syshdr.h"
+#include "linklist.h"
+#include "xmalloc.h"
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp((const char *)a, (const char *)b);
+}
+
+/* makes a list of the paths in NAMES, in the order of ORDER */
+static list *make_list(char **names, const unsigned int *order,
+					   unsigned int n)
+{
+	list *lp = list_new(0);
+	for(unsigned int i = 0; i < n; i++)
+		list_additem(lp, names[order[i]]);
+	return lp;
+}
+
+/* returns the time list_sort() takes on LP, checking the result */
+static double time_sort(list *lp, bool reverse)
+{
+	const double start = now_ms();
+	list_sort(lp, compare_paths, reverse);
+	const double ms = now_ms() - start;
+
+	for(listitem *li = lp->first; li && li->next; li = li->next) {
+		const int c = compare_paths(li->data, li->next->data);
+		if(reverse ? c < 0 : c > 0) {
+			fprintf(stderr, "list_sort() got the order wrong\n");
+			exit(1);
+		}
+	}
+	list_free(lp);
+	return ms;
+}
+
+int main(int argc, char **argv)
+{
+	const unsigned int max = (argc > 1 ? strtoul(argv[1], 0, 10) : 1000000);
+	if(max == 0) {
+		fprintf(stderr, "usage: %s [max entries]\n", argv[0]);
+		return 1;
+	}
+
+	char **names = xmalloc(max * sizeof(char *));
+	unsigned int *sorted = xmalloc(max * sizeof(unsigned int));
+	unsigned int *shuffled = xmalloc(max * sizeof(unsigned int));
+	for(unsigned int i = 0; i < max; i++) {
+		if(asprintf(&names[i], "/pub/mirror/file-%07u.tar.gz", i) == -1)
+			return 1;
+		sorted[i] = shuffled[i] = i;
+	}
+
+	printf("%10s %12s %12s %12s\n", "entries", "random ms", "sorted ms",
+		   "reverse ms");
+	srand(1);
+	for(unsigned int n = 1000; n <= max; n *= 10) {
+		for(unsigned int i = n - 1; i > 0; i--) {
+			const unsigned int j = rand() % (i + 1);
+			const unsigned int t = shuffled[i];
+			shuffled[i] = shuffled[j];
+			shuffled[j] = t;
+		}
+
+		const double random = time_sort(make_list(names, shuffled, n), false);
+		const double in_order = time_sort(make_list(names, sorted, n), false);
+		const double reverse = time_sort(make_list(names, sorted, n), true);
+		printf("%10u %12.2f %12.2f %12.2f\n", n, random, in_order, reverse);
+
+		/* the next size starts from a fresh order */
+		for(unsigned int i = 0; i < n * 10 && i < max; i++)
+			shuffled[i] = i;
+	}
+
+	for(unsigned int i = 0; i < max; i++)
+		free(names[i]);
+	free(names);
+	free(sorted);
+	free(shuffled);
+	return 0;
+}
@@ -27,6 +27,7 @@
 #include "prompt.h"
 #include "ltag.h"
 #include "lscolors.h"
+#include "ftpwalk.h"
 
 //static void exe_cmdline(char *str, bool aliases_are_expanded);
 
@@ -77,6 +78,7 @@ void command_loop(void)
 			printf(_("restarted command loop, connection closed\n"));
 		else
 			printf(_("restarted command loop, command aborted\n"));
+		ftp_walk_end();
 	}
 	gvJmpBufSet = true;
 	force_completion_type = cpUnset;
@@ -198,6 +200,7 @@ static void exe_cmd(cmd_t *c, args_t *args)
 		gvInterrupted = false;
 		gvInTransfer = false;
 		close_redirection();
+		ftp_walk_end();
 		ftp_cache_flush();
 	}
 }
@@ -725,6 +725,7 @@ void cmd_cache(int argc, char **argv)
 	struct option longopts[] = {
 		{"clear", no_argument, 0, 'c'},
 		{"list", no_argument, 0, 'l'},
+		{"stats", no_argument, 0, 's'},
 		{"touch", no_argument, 0, 't'},
 		{"help", no_argument, 0, 'h'},
 		{0, 0, 0, 0}
@@ -732,7 +733,7 @@ void cmd_cache(int argc, char **argv)
 	bool touch = false;
 
 	optind = 0;
-	while((c = getopt_long(argc, argv, "clt::h", longopts, 0)) != EOF) {
+	while((c = getopt_long(argc, argv, "clst::h", longopts, 0)) != EOF) {
 		switch(c) {
 		  case 'c':
 			ftp_cache_clear();
@@ -740,13 +741,17 @@ void cmd_cache(int argc, char **argv)
 		  case 'l':
 			ftp_cache_list_contents();
 			return;
+		  case 's':
+			ftp_cache_stats();
+			return;
 		  case 't':
 			  touch = true;
 			  break;
 		  case 'h':
         show_help(_("Control the directory cache."), "cache [option] [directories]",
           _("  -c, --clear        clear whole directory cache\n"
-					  "  -l, --list         list contents of cache\n"
+					  "  -l, --list         list contents of cache and memory used\n"
+					  "  -s, --stats        show cache size, hits, misses and evictions\n"
 					  "  -t, --touch        remove directories from cache\n"
 					  "                     if none given, remove current directory\n"));
 			return;
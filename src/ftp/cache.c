@@ -17,6 +17,359 @@
 #include "strq.h"
 #include "gvars.h"
 
+/* the directories in ftp->cache are also kept in a hash table on their
+ * path, so lookups don't have to walk the whole list
+ *
+ * ftp->cache is kept in least recently used order, and with
+ * cache_max_dirs or cache_max_memory set, the least recently used
+ * directories are removed when a new one is added
+ *
+ * a sparse directory only has the files that were looked up one by one
+ * with MLST; it isn't returned as a directory listing, and when it is
+ * replaced by the listing, it is kept until the end of the command, as
+ * its files may still be in use
+ *
+ * the files in a directory matching a mask, as listed by the server, are
+ * kept as a view of the directory in a separate, short list, so they are
+ * never taken for the whole directory; views count towards the limits
+ * like directories, and are evicted first
+ */
+typedef struct cache_node
+{
+  listitem *li;                /* item in ftp->cache */
+  unsigned int hash;
+  size_t bytes;                /* memory used by the directory */
+  struct cache_node *next;
+} cache_node;
+
+struct cache_index
+{
+  cache_node **buckets;
+  size_t size;                 /* number of buckets, a power of 2 */
+  size_t count;
+  size_t bytes;                /* memory used by all directories and views */
+  unsigned long hits, misses, evictions, revalidations;
+  unsigned long view_hits, view_misses;
+  unsigned int held;           /* eviction is held off while nonzero */
+  list *replaced;              /* sparse directories to free on flush */
+  list *views;                 /* directories filtered by the server */
+};
+
+#define CACHE_INDEX_SIZE 64
+#define CACHE_MAX_VIEWS 16
+
+/* FNV-1a */
+static unsigned int cache_hash(const char *path)
+{
+  unsigned int h = 2166136261u;
+  for (; *path; path++)
+  {
+    h ^= (unsigned char)*path;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void ftp_cache_index_free(struct cache_index *index)
+{
+  if (!index)
+    return;
+
+  for (size_t i = 0; i < index->size; i++)
+  {
+    cache_node* n = index->buckets[i];
+    while (n)
+    {
+      cache_node* next = n->next;
+      free(n);
+      n = next;
+    }
+  }
+  free(index->buckets);
+  list_free(index->replaced);
+  list_free(index->views);
+  free(index);
+}
+
+static void cache_index_grow(struct cache_index *index)
+{
+  const size_t size = index->size * 2;
+  cache_node** buckets = xmalloc(size * sizeof(cache_node *));
+
+  for (size_t i = 0; i < index->size; i++)
+  {
+    cache_node* n = index->buckets[i];
+    while (n)
+    {
+      cache_node* next = n->next;
+      n->next = buckets[n->hash & (size - 1)];
+      buckets[n->hash & (size - 1)] = n;
+      n = next;
+    }
+  }
+  free(index->buckets);
+  index->buckets = buckets;
+  index->size = size;
+}
+
+/* returns the bucket link pointing to the node for PATH, which is 0 if
+ * PATH is not cached
+ */
+static cache_node **cache_index_find(const char *path)
+{
+  struct cache_index* index = ftp->cache_index;
+  if (!index)
+    return NULL;
+
+  const unsigned int h = cache_hash(path);
+  cache_node** np = &index->buckets[h & (index->size - 1)];
+  for (; *np; np = &(*np)->next)
+  {
+    if ((*np)->hash == h
+        && strcmp(((rdirectory *)(*np)->li->data)->path, path) == 0)
+      break;
+  }
+  return np;
+}
+
+static struct cache_index *cache_index_get(void)
+{
+  if (!ftp->cache_index)
+  {
+    struct cache_index* index = xmalloc(sizeof(struct cache_index));
+    index->size = CACHE_INDEX_SIZE;
+    index->buckets = xmalloc(index->size * sizeof(cache_node *));
+    index->replaced = list_new((listfunc)rdir_destroy);
+    index->views = list_new((listfunc)rdir_destroy);
+    ftp->cache_index = index;
+  }
+  return ftp->cache_index;
+}
+
+static bool cache_timed_out(const rdirectory *rdir, time_t now)
+{
+  return gvCacheTimeout && rdir->timestamp + gvCacheTimeout <= now;
+}
+
+/* returns true if RDIR must be checked before it is used: it has timed
+ * out, or it is from the saved cache and there is no timeout to go by
+ */
+static bool cache_stale(const rdirectory *rdir, time_t now)
+{
+  return cache_timed_out(rdir, now) || (rdir->loaded && !gvCacheTimeout);
+}
+
+/* returns true if RDIR is worth saving, ie it can be used or checked
+ * when it is loaded again
+ */
+static bool cache_saveable(const rdirectory *rdir, time_t now)
+{
+  if (rdir->sparse)
+    return false;
+  if (rdir->mtime != (time_t)-1)
+    return true;
+  return gvCacheTimeout && !cache_timed_out(rdir, now);
+}
+
+static listitem *cache_lookup(const char *path)
+{
+  cache_node** np = cache_index_find(path);
+  return np && *np ? (*np)->li : NULL;
+}
+
+/* takes the directory PATH out of the cache, without freeing it
+ * returns the directory, or 0 if it wasn't cached
+ */
+static rdirectory *cache_unlink(const char *path)
+{
+  cache_node** np = cache_index_find(path);
+  if (!np || !*np)
+    return NULL;
+
+  cache_node* n = *np;
+  rdirectory* rdir = n->li->data;
+  *np = n->next;
+  ftp->cache_index->count--;
+  ftp->cache_index->bytes -= n->bytes;
+  list_removeitem(ftp->cache, n->li);
+  free(n->li);
+  free(n);
+  return rdir;
+}
+
+/* removes the directory PATH from the cache
+ * returns true if it was cached
+ */
+static bool cache_remove(const char *path)
+{
+  rdirectory* rdir = cache_unlink(path);
+  rdir_destroy(rdir);
+  return rdir != NULL;
+}
+
+/* removes the view at LI */
+static void cache_remove_view(listitem *li)
+{
+  struct cache_index* index = ftp->cache_index;
+
+  index->bytes -= rdir_memory(li->data);
+  list_delitem(index->views, li);
+}
+
+/* removes the least recently used views, and then directories, but not
+ * KEEP, until the cache is within cache_max_dirs and cache_max_memory
+ */
+static void cache_evict(const rdirectory *keep)
+{
+  struct cache_index* index = ftp->cache_index;
+
+  if (index->held)
+    return;
+  while ((gvCacheMaxDirs
+          && index->count + list_numitem(index->views) > gvCacheMaxDirs)
+         || (gvCacheMaxMemory && index->bytes > gvCacheMaxMemory))
+  {
+    listitem* li = index->views->first;
+    if (li && li->data != keep)
+    {
+      const rdirectory* rdir = li->data;
+      ftp_trace("evicted files in '%s' matching '%s' from cache\n",
+                rdir->path, rdir->filter);
+      cache_remove_view(li);
+    }
+    else if (ftp->cache->first && ftp->cache->first->data != keep)
+    {
+      const rdirectory* rdir = ftp->cache->first->data;
+      ftp_trace("evicted directory '%s' from cache\n", rdir->path);
+      cache_remove(rdir->path);
+    }
+    else
+      break;
+    index->evictions++;
+  }
+}
+
+/* adds RDIR to the cache, replacing any directory with the same path
+ */
+void ftp_cache_add(rdirectory *rdir)
+{
+  struct cache_index* index = cache_index_get();
+
+  rdirectory* old = cache_unlink(rdir->path);
+  if (old && old->sparse)
+    list_additem(index->replaced, old);
+  else
+    rdir_destroy(old);
+
+  if (index->count >= index->size)
+    cache_index_grow(index);
+
+  list_additem(ftp->cache, rdir);
+
+  cache_node* n = xmalloc(sizeof(cache_node));
+  n->li = ftp->cache->last;
+  n->hash = cache_hash(rdir->path);
+  n->bytes = rdir_memory(rdir);
+  n->next = index->buckets[n->hash & (index->size - 1)];
+  index->buckets[n->hash & (index->size - 1)] = n;
+  index->count++;
+  index->bytes += n->bytes;
+
+  cache_evict(rdir);
+}
+
+/* holds off eviction until ftp_cache_release(), so the directories
+ * added meanwhile, such as those the walk delivers during a lookup,
+ * don't free one that is about to be returned
+ */
+void ftp_cache_hold(void)
+{
+  cache_index_get()->held++;
+}
+
+/* ends ftp_cache_hold(), evicting what is over the limits, but not KEEP
+ */
+void ftp_cache_release(const rdirectory *keep)
+{
+  struct cache_index* index = ftp->cache_index;
+
+  /* the cache is cleared if the connection was lost meanwhile */
+  if (!index || !index->held)
+    return;
+  if (--index->held == 0)
+    cache_evict(keep);
+}
+
+static listitem *cache_find_view(const char *path, const char *filter)
+{
+  for (listitem* li = cache_index_get()->views->first; li; li = li->next)
+  {
+    const rdirectory* rdir = li->data;
+    if (strcmp(rdir->path, path) == 0 && strcmp(rdir->filter, filter) == 0)
+      return li;
+  }
+  return NULL;
+}
+
+/* removes the views of the directory PATH */
+static void cache_remove_views(const char *path)
+{
+  list* views = cache_index_get()->views;
+  for (listitem* li = views->first; li;)
+  {
+    listitem* next = li->next;
+    if (strcmp(((rdirectory *)li->data)->path, path) == 0)
+      cache_remove_view(li);
+    li = next;
+  }
+}
+
+/* PATH is absolute */
+/* returns the files in the directory PATH matching FILTER from the
+ * cache, or 0 if not found
+ */
+rdirectory *ftp_cache_get_view(const char *path, const char *filter)
+{
+  struct cache_index* index = cache_index_get();
+  listitem* li = cache_find_view(path, filter);
+
+  if (li && cache_timed_out(li->data, time(0)))
+  {
+    /* the view isn't used elsewhere, rglob_glob() copies the files */
+    ftp_trace("Directory cache for '%s' matching '%s' has timed out\n",
+          path, filter);
+    cache_remove_view(li);
+    li = NULL;
+  }
+
+  if (!li)
+  {
+    index->view_misses++;
+    return NULL;
+  }
+  index->view_hits++;
+  list_movelast(index->views, li);
+  return li->data;
+}
+
+/* adds RDIR, which has the files matching RDIR->filter, as a view of
+ * its directory
+ */
+void ftp_cache_add_view(rdirectory *rdir)
+{
+  struct cache_index* index = cache_index_get();
+
+  listitem* li = cache_find_view(rdir->path, rdir->filter);
+  if (li)
+    cache_remove_view(li);
+  list_additem(index->views, rdir);
+  index->bytes += rdir_memory(rdir);
+  if (list_numitem(index->views) > CACHE_MAX_VIEWS)
+    cache_remove_view(index->views->first);
+  cache_evict(rdir);
+}
+
+/* lists the cached directories, least recently used first */
 void ftp_cache_list_contents(void)
 {
   ftp_cache_flush();
@@ -25,7 +378,42 @@ void ftp_cache_list_contents(void)
        list_numitem(ftp->cache));
 
   for (listitem* li = ftp->cache->first; li; li = li->next)
-    printf("%s\n", ((rdirectory *)li->data)->path);
+  {
+    const rdirectory* rdir = li->data;
+    cache_node** np = cache_index_find(rdir->path);
+    printf("%10zu %s%s\n", np && *np ? (*np)->bytes : 0, rdir->path,
+           rdir->sparse ? _(" (some files)") : "");
+  }
+  for (listitem* li = cache_index_get()->views->first; li; li = li->next)
+  {
+    const rdirectory* rdir = li->data;
+    printf("%10zu %s%s%s (matching)\n", rdir_memory(rdir), rdir->path,
+           strcmp(rdir->path, "/") ? "/" : "", rdir->filter);
+  }
+}
+
+void ftp_cache_stats(void)
+{
+  ftp_cache_flush();
+
+  const struct cache_index* index = cache_index_get();
+  const unsigned long lookups = index->hits + index->misses;
+
+  printf(_("Directory cache statistics:\n"));
+  printf(_("  entries:   %zu"), index->count);
+  if (gvCacheMaxDirs)
+    printf(_(" (max %u)"), gvCacheMaxDirs);
+  printf(_("\n  memory:    %zu bytes"), index->bytes);
+  if (gvCacheMaxMemory)
+    printf(_(" (max %zu)"), gvCacheMaxMemory);
+  printf(_("\n  hits:      %lu"), index->hits);
+  if (lookups)
+    printf(" (%.1f%%)", 100.0 * index->hits / lookups);
+  printf(_("\n  misses:    %lu\n"), index->misses);
+  printf(_("  views:     %zu (hits %lu, misses %lu)\n"),
+         list_numitem(index->views), index->view_hits, index->view_misses);
+  printf(_("  evictions: %lu\n"), index->evictions);
+  printf(_("  revalidated: %lu\n"), index->revalidations);
 }
 
 /* marks the directory PATH to be flushed in the
@@ -59,11 +447,6 @@ void ftp_cache_flush_mark_for(const char *path)
   free(e);
 }
 
-static int cache_search(rdirectory *rdir, const char *arg)
-{
-  return strcmp(rdir->path, arg);
-}
-
 /* flushes directories marked by ftp_cache_flush_mark*()
  */
 void ftp_cache_flush(void)
@@ -71,30 +454,50 @@ void ftp_cache_flush(void)
   for (listitem* li = ftp->dirs_to_flush->first; li; li = li->next)
   {
     char* dir = li->data;
-    listitem* e = list_search(ftp->cache, (listsearchfunc)cache_search, dir);
-    if (e)
-    {
+    if (cache_remove(dir))
       ftp_trace("flushed directory '%s'\n", dir);
-      list_delitem(ftp->cache, e);
-    }
     else
       ftp_trace("error flushing directory '%s' (not cached)\n", dir);
+    cache_remove_views(dir);
   }
 
   list_clear(ftp->dirs_to_flush);
+  if (ftp->cache_index)
+    list_clear(ftp->cache_index->replaced);
 }
 
 void ftp_cache_clear(void)
 {
   list_clear(ftp->dirs_to_flush);
   list_clear(ftp->cache);
+  ftp_cache_index_free(ftp->cache_index);
+  ftp->cache_index = NULL;
   ftp_trace("clear whole directory cache\n");
 }
 
+/* checks if the directory RDIR, which is stale, has the same
+ * modification time as when it was listed; if so, it is kept
+ * returns true if the cached listing is still valid
+ */
+static bool cache_revalidate(rdirectory *rdir)
+{
+  if (rdir->mtime == (time_t)-1)
+    return false;
+
+  const time_t mtime = ftp_dir_mtime(rdir->path);
+  if (mtime == (time_t)-1 || mtime != rdir->mtime || !ftp->cache_index)
+    return false;
+
+  rdir->timestamp = time(0);
+  rdir->loaded = false;
+  ftp->cache_index->revalidations++;
+  return true;
+}
+
 /* PATH is NOT quoted */
-/* returns a directory from the cache, or 0 if not found
+/* returns a directory from the cache, sparse or not, or 0 if not found
  */
-rdirectory *ftp_cache_get_directory(const char *path)
+static rdirectory *cache_get(const char *path)
 {
   char *dir_to_search_for = NULL;
   if(path)
@@ -102,17 +505,53 @@ rdirectory *ftp_cache_get_directory(const char *path)
   else
     dir_to_search_for = xstrdup(ftp->curdir);
 
-  listitem* li = list_search(ftp->cache, (listsearchfunc)cache_search,
-           dir_to_search_for);
+  listitem* li = cache_lookup(dir_to_search_for);
+
+  struct cache_index* index = cache_index_get();
+  if (li)
+  {
+    index->hits++;
+    list_movelast(ftp->cache, li);
+  }
+  else
+    index->misses++;
 
-  if(li && gvCacheTimeout &&
-     ((rdirectory *)li->data)->timestamp + gvCacheTimeout <= time(0))
+  rdirectory* rdir = li ? li->data : NULL;
+  if (rdir && rdir->loaded)
   {
-    /* directory cache has timed out */
+    /* a directory from an earlier session, which hasn't been handed out
+     * yet, so it can be dropped at once if it has changed
+     */
+    const bool valid = !cache_stale(rdir, time(0)) || cache_revalidate(rdir);
+    li = cache_lookup(dir_to_search_for);
+    if (valid && li)
+      rdir->loaded = false;
+    else if (li)
+    {
+      ftp_trace("Saved directory cache for '%s' is out of date\n",
+            dir_to_search_for);
+      cache_remove(dir_to_search_for);
+      li = NULL;
+    }
+  }
+  else if(li && cache_timed_out(li->data, time(0))
+     && !list_search(ftp->dirs_to_flush, (listsearchfunc)strcmp,
+                     dir_to_search_for))
+  {
+    /* directory cache has timed out, unless the directory is unchanged */
 
-    ftp_trace("Directory cache for '%s' has timed out\n",
-          dir_to_search_for);
-    ftp_cache_flush_mark(dir_to_search_for);
+    const bool valid = cache_revalidate(li->data);
+    /* the cache is cleared if the connection was lost meanwhile */
+    li = cache_lookup(dir_to_search_for);
+    if (valid && li)
+      ftp_trace("Directory cache for '%s' is still valid\n",
+            dir_to_search_for);
+    else if (li)
+    {
+      ftp_trace("Directory cache for '%s' has timed out\n",
+            dir_to_search_for);
+      ftp_cache_flush_mark(dir_to_search_for);
+    }
   }
   free(dir_to_search_for);
 
@@ -122,6 +561,55 @@ rdirectory *ftp_cache_get_directory(const char *path)
   return li->data;
 }
 
+/* PATH is NOT quoted */
+/* returns a directory listing from the cache, or 0 if not found
+ */
+rdirectory *ftp_cache_get_directory(const char *path)
+{
+  rdirectory* rdir = cache_get(path);
+  return rdir && !rdir->sparse ? rdir : NULL;
+}
+
+/* returns true if the cache has the listing of the directory PATH,
+ * so a file that isn't there doesn't exist
+ */
+bool ftp_cache_has_listing(const char *path)
+{
+  char* p = ftp_path_absolute(path);
+  stripslash(p);
+  listitem* li = cache_lookup(p);
+  free(p);
+  return li && !((rdirectory *)li->data)->sparse;
+}
+
+/* adds a copy of F, looked up by itself, to the sparse directory
+ * DIRPATH in the cache
+ * returns the cached file
+ */
+rfile *ftp_cache_add_file(const char *dirpath, const rfile *f)
+{
+  listitem* li = cache_lookup(dirpath);
+  rdirectory* rdir = li ? li->data : NULL;
+  if (!rdir)
+  {
+    rdir = rdir_create();
+    rdir->path = xstrdup(dirpath);
+    rdir->sparse = true;
+    ftp_cache_add(rdir);
+  }
+
+  rdir_add_file(rdir, f);
+
+  cache_node* n = *cache_index_find(dirpath);
+  ftp->cache_index->bytes -= n->bytes;
+  n->bytes = rdir_memory(rdir);
+  ftp->cache_index->bytes += n->bytes;
+  list_movelast(ftp->cache, n->li);
+  cache_evict(rdir);
+
+  return rdir->files->last->data;
+}
+
 /* returns a file from the cache, or 0 if not found
  */
 rfile *ftp_cache_get_file(const char *path)
@@ -130,7 +618,7 @@ rfile *ftp_cache_get_file(const char *path)
     return NULL;
 
   char* dir = base_dir_xptr(path);
-  rdirectory* rdir = ftp_cache_get_directory(dir);
+  rdirectory* rdir = cache_get(dir);
   free(dir);
 
   if (rdir)
@@ -138,3 +626,372 @@ rfile *ftp_cache_get_file(const char *path)
 
   return NULL;
 }
+
+/* The cache can be saved in the working directory when the connection
+ * is closed, and loaded again on the next login to the same site, in
+ * a file per user, host and port. The file is mapped into memory and
+ * read in place; integers are in native byte order:
+ *
+ *   header:    "yafcdc2\n", u32 0x01020304, u32 number of directories
+ *   directory: i64 timestamp, i64 directory mtime,
+ *              u32 number of files, string path
+ *   file:      i64 mtime, u64 size, u32 nhl,
+ *              strings perm, owner, group, date, link and name
+ *   string:    u32 length (CACHE_NULL for none), the chars and a nul
+ */
+
+#define CACHE_MAGIC "yafcdc2\n"
+#define CACHE_BOM 0x01020304u
+#define CACHE_NULL 0xffffffffu
+
+static char *cache_filename(void)
+{
+  if (!ftp->url || !ftp->host)
+    return NULL;
+
+  char* name = NULL;
+  if (asprintf(&name, "%s@%s:%u",
+               ftp->url->username ? ftp->url->username : "anonymous",
+               host_getoname(ftp->host),
+               (unsigned)ntohs(host_getport(ftp->host))) == -1)
+    return NULL;
+  for (char* e = name; *e; e++)
+  {
+    if (*e == '/')
+      *e = '_';
+  }
+
+  char* file = NULL;
+  if (asprintf(&file, "%s/cache/%s", gvWorkingDirectory, name) == -1)
+    file = NULL;
+  free(name);
+  return file;
+}
+
+static void put_u32(FILE *fp, uint32_t v)
+{
+  fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void put_u64(FILE *fp, uint64_t v)
+{
+  fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void put_str(FILE *fp, const char *s)
+{
+  if (!s)
+  {
+    put_u32(fp, CACHE_NULL);
+    return;
+  }
+  const size_t len = strlen(s);
+  put_u32(fp, len);
+  fwrite(s, 1, len + 1, fp);
+}
+
+/* writes the directory RDIR and its files */
+static void cache_write_dir(FILE *fp, const rdirectory *rdir)
+{
+  put_u64(fp, (uint64_t)(int64_t)rdir->timestamp);
+  put_u64(fp, (uint64_t)(int64_t)rdir->mtime);
+  put_u32(fp, list_numitem(rdir->files));
+  put_str(fp, rdir->path);
+
+  for (listitem* fi = rdir->files->first; fi; fi = fi->next)
+  {
+    const rfile* f = fi->data;
+    put_u64(fp, (uint64_t)(int64_t)f->mtime);
+    put_u64(fp, f->size);
+    put_u32(fp, f->nhl);
+    put_str(fp, f->perm);
+    put_str(fp, f->owner);
+    put_str(fp, f->group);
+    put_str(fp, f->date);
+    put_str(fp, f->link);
+    put_str(fp, base_name_ptr(f->path));
+  }
+}
+
+/* writes the directory RDIR to FP, to be read again with
+ * ftp_cache_read_directory()
+ * returns 0 on success, else -1
+ */
+int ftp_cache_write_directory(FILE *fp, const rdirectory *rdir)
+{
+  cache_write_dir(fp, rdir);
+  return ferror(fp) ? -1 : 0;
+}
+
+/* saves the cached directories that can be used or revalidated when
+ * they are loaded again
+ */
+void ftp_cache_save(void)
+{
+  if (!gvPersistentCache || !ftp->loggedin)
+    return;
+
+  char* file = cache_filename();
+  if (!file)
+    return;
+
+  char* dir = base_dir_xptr(file);
+  if (dir && access(dir, X_OK) != 0)
+  {
+    mkdir(dir, S_IRUSR|S_IWUSR|S_IXUSR);
+    chmod(dir, S_IRUSR|S_IWUSR|S_IXUSR);
+  }
+  free(dir);
+
+  char* tmp = NULL;
+  if (asprintf(&tmp, "%s.%u", file, (unsigned)getpid()) == -1)
+  {
+    free(file);
+    return;
+  }
+
+  FILE* fp = fopen(tmp, "w");
+  if (!fp)
+  {
+    ftp_trace("unable to save directory cache in %s: %s\n", tmp,
+              strerror(errno));
+    free(tmp);
+    free(file);
+    return;
+  }
+
+  ftp_cache_flush();
+
+  const time_t now = time(0);
+  uint32_t ndirs = 0;
+  for (listitem* li = ftp->cache->first; li; li = li->next)
+  {
+    if (cache_saveable(li->data, now))
+      ndirs++;
+  }
+
+  fwrite(CACHE_MAGIC, 1, strlen(CACHE_MAGIC), fp);
+  put_u32(fp, CACHE_BOM);
+  put_u32(fp, ndirs);
+
+  for (listitem* li = ftp->cache->first; li; li = li->next)
+  {
+    if (cache_saveable(li->data, now))
+      cache_write_dir(fp, li->data);
+  }
+
+  const bool failed = ferror(fp) != 0;
+  if (fclose(fp) != 0 || failed || rename(tmp, file) != 0)
+  {
+    ftp_trace("unable to save directory cache in %s\n", file);
+    unlink(tmp);
+  }
+  else
+    ftp_trace("saved %u directories in %s\n", ndirs, file);
+
+  free(tmp);
+  free(file);
+}
+
+typedef struct cache_reader
+{
+  const char* p;
+  const char* end;
+  bool bad;
+} cache_reader;
+
+static uint32_t get_u32(cache_reader *r)
+{
+  uint32_t v = 0;
+  if (r->end - r->p < (ptrdiff_t)sizeof(v))
+    r->bad = true;
+  else
+  {
+    memcpy(&v, r->p, sizeof(v));
+    r->p += sizeof(v);
+  }
+  return v;
+}
+
+static uint64_t get_u64(cache_reader *r)
+{
+  uint64_t v = 0;
+  if (r->end - r->p < (ptrdiff_t)sizeof(v))
+    r->bad = true;
+  else
+  {
+    memcpy(&v, r->p, sizeof(v));
+    r->p += sizeof(v);
+  }
+  return v;
+}
+
+/* returns the string in place, in the mapped file */
+static const char *get_str(cache_reader *r)
+{
+  const uint32_t len = get_u32(r);
+  if (r->bad || len == CACHE_NULL)
+    return NULL;
+  if ((uint64_t)(r->end - r->p) < (uint64_t)len + 1 || r->p[len] != 0)
+  {
+    r->bad = true;
+    return NULL;
+  }
+  const char* s = r->p;
+  r->p += len + 1;
+  return s;
+}
+
+/* reads a directory written by cache_write_dir(), the file paths are
+ * made in *PATH, of *PATH_SIZE bytes
+ * returns the directory, not sorted, or 0 if R is damaged
+ */
+static rdirectory *cache_read_dir(cache_reader *r, char **path,
+                                  size_t *path_size)
+{
+  const time_t timestamp = (time_t)(int64_t)get_u64(r);
+  const time_t mtime = (time_t)(int64_t)get_u64(r);
+  const uint32_t nfiles = get_u32(r);
+  const char* dirpath = get_str(r);
+  if (r->bad || !dirpath)
+  {
+    r->bad = true;
+    return NULL;
+  }
+
+  rdirectory* rdir = rdir_create();
+  rdir->path = xstrdup(dirpath);
+  rdir->timestamp = timestamp;
+  rdir->mtime = mtime;
+  const size_t dirlen = strlen(dirpath);
+
+  for (uint32_t j = 0; j < nfiles && !r->bad; j++)
+  {
+    rfile f;
+    memset(&f, 0, sizeof(f));
+    f.mtime = (time_t)(int64_t)get_u64(r);
+    f.size = get_u64(r);
+    f.nhl = get_u32(r);
+    f.perm = (char *)get_str(r);
+    f.owner = (char *)get_str(r);
+    f.group = (char *)get_str(r);
+    f.date = (char *)get_str(r);
+    f.link = (char *)get_str(r);
+    const char* name = get_str(r);
+    if (r->bad || !name)
+    {
+      r->bad = true;
+      break;
+    }
+
+    const size_t len = dirlen + strlen(name) + 2;
+    if (len > *path_size)
+    {
+      *path_size = len * 2;
+      *path = xrealloc(*path, *path_size);
+    }
+    snprintf(*path, *path_size, "%s/%s",
+             strcmp(dirpath, "/") ? dirpath : "", name);
+    f.path = *path;
+    rdir_add_file(rdir, &f);
+  }
+
+  if (r->bad)
+  {
+    rdir_destroy(rdir);
+    return NULL;
+  }
+  return rdir;
+}
+
+/* reads a directory written by ftp_cache_write_directory() from the LEN
+ * bytes at BUF
+ * returns the sorted directory, or 0 if it is damaged
+ */
+rdirectory *ftp_cache_read_directory(const char *buf, size_t len)
+{
+  cache_reader r = { buf, buf + len, false };
+  char* path = NULL;
+  size_t path_size = 0;
+
+  rdirectory* rdir = cache_read_dir(&r, &path, &path_size);
+  free(path);
+  if (rdir)
+    rdir_sort(rdir);
+  return rdir;
+}
+
+/* adds the saved directories to the cache, except those that are
+ * already cached or can't be revalidated when they must be; the others
+ * are checked for changes when they are first used, unless
+ * cache_timeout says they are still fresh
+ */
+void ftp_cache_load(void)
+{
+  if (!gvPersistentCache)
+    return;
+
+  char* file = cache_filename();
+  if (!file)
+    return;
+
+  const int fd = open(file, O_RDONLY);
+  if (fd == -1)
+  {
+    free(file);
+    return;
+  }
+
+  struct stat sb;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &sb) == 0 && sb.st_size > 0)
+    map = mmap(0, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    free(file);
+    return;
+  }
+
+  cache_reader r = { map, (const char *)map + sb.st_size, false };
+  const size_t magic_len = strlen(CACHE_MAGIC);
+  if ((size_t)sb.st_size < magic_len
+      || memcmp(r.p, CACHE_MAGIC, magic_len) != 0)
+    r.bad = true;
+  else
+    r.p += magic_len;
+  if (!r.bad && get_u32(&r) != CACHE_BOM)
+    r.bad = true;
+
+  const uint32_t ndirs = r.bad ? 0 : get_u32(&r);
+  const time_t now = time(0);
+  char* path = NULL;
+  size_t path_size = 0;
+  unsigned loaded = 0;
+
+  for (uint32_t i = 0; i < ndirs && !r.bad; i++)
+  {
+    rdirectory* rdir = cache_read_dir(&r, &path, &path_size);
+    if (!rdir)
+      break;
+
+    rdir->loaded = true;
+    if (cache_lookup(rdir->path)
+        || (cache_stale(rdir, now) && rdir->mtime == (time_t)-1))
+    {
+      rdir_destroy(rdir);
+      continue;
+    }
+    rdir_sort(rdir);
+    ftp_cache_add(rdir);
+    loaded++;
+  }
+
+  if (r.bad)
+    ftp_trace("directory cache %s is damaged\n", file);
+  ftp_trace("loaded %u directories from %s\n", loaded, file);
+
+  free(path);
+  munmap(map, sb.st_size);
+  free(file);
+}
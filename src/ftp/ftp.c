@@ -13,6 +13,7 @@
 #include "syshdr.h"
 
 #include "ftp.h"
+#include "ftpwalk.h"
 #include "xmalloc.h"
 #include "strq.h"
 #include "gvars.h"
@@ -115,7 +116,12 @@ void ftp_destroy(Ftp *ftp)
 
     list_free(ftp->dirs_to_flush);
     list_free(ftp->cache);
+    ftp_cache_index_free(ftp->cache_index);
     ftp->cache = ftp->dirs_to_flush = NULL;
+    ftp->cache_index = NULL;
+    /* after the cache, which points into it */
+    arena_free(ftp->strings);
+    ftp->strings = NULL;
     host_destroy(ftp->host);
     sock_destroy(ftp->data);
     sock_destroy(ftp->ctrl);
@@ -126,6 +132,7 @@ void ftp_destroy(Ftp *ftp)
     free(ftp->homedir);
     free(ftp->curdir);
     free(ftp->prevdir);
+    free(ftp->reply_facts);
     list_free(ftp->taglist);
     free(ftp->ti.remote_name);
     free(ftp->ti.local_name);
@@ -203,9 +210,14 @@ void ftp_reset_vars(void)
     ftp->has_site_chmod_command = true;
     ftp->has_site_idle_command = true;
     ftp->has_mlsd_command = true;
+    ftp->has_mlst_command = true;
+    ftp->has_dir_mdtm = true;
+    ftp->has_list_glob = true;
 
     list_clear(ftp->dirs_to_flush);
     list_clear(ftp->cache);
+    ftp_cache_index_free(ftp->cache_index);
+    ftp->cache_index = NULL;
 
     /* don't assume server is in ascii mode initially even if RFC says so */
     ftp->prev_type = '?';
@@ -236,6 +248,7 @@ void ftp_close(void)
     if(gvLoadTaglist != 0) {
         save_taglist(0);
     }
+    ftp_cache_save();
     ftp_reset_vars();
 }
 
@@ -427,6 +440,65 @@ int ftp_reopen(void)
     return -1;
 }
 
+/* opens an extra session to the same site as the current one, used to
+ * run several data connections at once; the current session stays in use
+ * never prompts for a password, so the current session must have one
+ * returns the new logged in session, or 0 on failure
+ */
+Ftp *ftp_open_clone(void)
+{
+    Ftp *thisftp = ftp, *cloneftp;
+    url_t *u;
+    int r;
+
+    if(!ftp || !ftp->url || !ftp_loggedin())
+        return 0;
+#ifdef HAVE_LIBSSH
+    if(ftp->session)
+        return 0;
+#endif
+
+    u = url_clone(ftp->url);
+    url_setdirectory(u, ftp->curdir);
+
+    cloneftp = ftp_create();
+    cloneftp->verbosity = vbError;
+    ftp_use(cloneftp);
+
+    r = ftp_open_url(u, true);
+    if(r == 0)
+        r = ftp_login(u->username, gvAnonPasswd);
+    url_destroy(u);
+
+    ftp_use(thisftp);
+    if(r != 0) {
+        ftp_close_clone(cloneftp);
+        return 0;
+    }
+    return cloneftp;
+}
+
+/* closes and destroys a session opened with ftp_open_clone()
+ * unlike ftp_close(), it doesn't touch bookmarks or taglists
+ */
+void ftp_close_clone(Ftp *cloneftp)
+{
+    Ftp *thisftp = ftp;
+
+    if(!cloneftp)
+        return;
+
+    ftp_use(cloneftp);
+    if(ftp_connected()) {
+        ftp_reply_timeout(10);
+        ftp_set_tmp_verbosity(vbNone);
+        ftp_cmd("QUIT");
+    }
+    ftp_reset_vars();
+    ftp_use(thisftp);
+    ftp_destroy(cloneftp);
+}
+
 /* reads one line from server into ftp->reply
  * returns 0 on success or -1 on failure
  */
@@ -613,12 +685,20 @@ int ftp_read_reply(void)
 
     ftp_print_reply();
 
+    free(ftp->reply_facts);
+    ftp->reply_facts = 0;
+
     if(ftp->reply[3] == '-') {  /* multiline response */
         strncpy(tmp, ftp->reply, 3);
         do {
             if(ftp_gets() == -1)
                 break;
             ftp_print_reply();
+            /* the facts in an MLST reply are on a line starting with
+             * a space (RFC 3659)
+             */
+            if(ftp->reply[0] == ' ' && !ftp->reply_facts)
+                ftp->reply_facts = xstrdup(ftp->reply + 1);
         } while(strncmp(tmp, ftp->reply, 4) != 0);
     }
     ftp->tmp_verbosity = vbUnset;
@@ -1089,6 +1169,7 @@ int ftp_login(const char *guessed_username, const char *anonpass)
         ftp->homedir = ftp_getcurdir();
         ftp->curdir = xstrdup(ftp->homedir);
         ftp->prevdir = xstrdup(ftp->homedir);
+        ftp_cache_load();
         if(ftp->url->directory)
             ftp_chdir(ftp->url->directory);
         ftp_get_feat();
@@ -1385,13 +1466,28 @@ unsigned long long ftp_filesize(const char *path)
     return -1;
 }
 
+/* returns the modification time of DIR, which exists, for its listing
+ * a server that refuses MDTM on it won't be asked again
+ */
+static time_t ftp_listed_dir_mtime(const char *dir)
+{
+    const time_t mtime = ftp_dir_mtime(dir);
+    /* MDTM was sent if MLST isn't there */
+    if(mtime == (time_t)-1 && !ftp->has_mlst_command && ftp->has_dir_mdtm
+       && ftp->has_mdtm_command && ftp_connected() && !ftp->data
+       && ftp->code == ctError) {
+        ftp_trace("MDTM doesn't work on directories\n");
+        ftp->has_dir_mdtm = false;
+    }
+    return mtime;
+}
+
 rdirectory *ftp_read_directory(const char *path)
 {
-    FILE *fp = 0;
     rdirectory *rdir;
+    rdir_parser *parser = 0;
     bool _failed = false;
     char *dir;
-    bool is_mlsd = false;
 
 #ifdef HAVE_LIBSSH
     if (ftp->session)
@@ -1403,11 +1499,7 @@ rdirectory *ftp_read_directory(const char *path)
 
     bool is_curdir = (strcmp(dir, ftp->curdir) == 0);
 
-    if((fp = tmpfile()) == NULL) {	/* can't create a tmpfile */
-        ftp_err("Unable to create temp file: %s\n", strerror(errno));
-        free(dir);
-        return 0;
-    }
+    rdir = rdir_create();
 
     /* we do a "CWD" before the listing, because: we want a listing of
      *  the directory contents, not the directory itself, and some
@@ -1420,8 +1512,22 @@ rdirectory *ftp_read_directory(const char *path)
             goto failed;
     }
 
+    /* to check later, or in a later session, if the cached listing is
+     * still valid; MLSD usually gives it in the type=cdir entry, else it
+     * is asked for before the listing, so a change while listing isn't
+     * missed
+     */
+    const bool want_mtime = (gvCacheTimeout || gvPersistentCache);
+    bool mtime_asked = false;
+    time_t mtime = (time_t)-1;
+    if(want_mtime && !ftp->has_mlsd_command) {
+        mtime = ftp_listed_dir_mtime(dir);
+        mtime_asked = true;
+    }
+
+    /* the listing is parsed while it is received */
     if(ftp->has_mlsd_command) {
-        is_mlsd = true;
+        parser = rdir_parse_begin(rdir, dir, true);
 #if 0
         /* PureFTPd (1.0.11) doesn't recognize directory arguments
          * with spaces, not even quoted, it just chops the argument
@@ -1434,17 +1540,28 @@ rdirectory *ftp_read_directory(const char *path)
          * doing a 'MLSD link-to-dir' on PureFTPd closes the control
          * connection, however, 'MLSD link-to-dir/' works fine.
          */
-        _failed = (ftp_list("MLSD", asdf, fp) != 0);
+        _failed = (ftp_list_stream("MLSD", asdf,
+                                   (ftp_list_func)rdir_parse_data,
+                                   parser) != 0);
         free(asdf);
 #else
-        _failed = (ftp_list("MLSD", 0, fp) != 0);
+        _failed = (ftp_list_stream("MLSD", 0, (ftp_list_func)rdir_parse_data,
+                                   parser) != 0);
 #endif
-        if(_failed && ftp->code == ctError)
+        if(_failed && ftp->code == ctError) {
             ftp->has_mlsd_command = false;
+            rdir_parse_end(parser);
+            parser = 0;
+        }
     }
     if(!ftp->has_mlsd_command) {
-        _failed = (ftp_list("LIST", 0, fp) != 0);
-        is_mlsd = false;
+        if(want_mtime && !mtime_asked) {
+            mtime = ftp_listed_dir_mtime(dir);
+            mtime_asked = true;
+        }
+        parser = rdir_parse_begin(rdir, dir, false);
+        _failed = (ftp_list_stream("LIST", 0, (ftp_list_func)rdir_parse_data,
+                                   parser) != 0);
     }
 
     if(!is_curdir)
@@ -1453,26 +1570,25 @@ rdirectory *ftp_read_directory(const char *path)
     if(_failed)
         goto failed;
 
-    rewind(fp);
-
-    rdir = rdir_create();
-    if(rdir_parse(rdir, fp, dir, is_mlsd) != 0) {
-        rdir_destroy(rdir);
-        rdir = NULL;
+    _failed = (rdir_parse_end(parser) != 0);
+    parser = 0;
+    if(_failed)
         goto failed;
-    }
 
-    fclose(fp);
+    /* no type=cdir entry */
+    if(want_mtime && rdir->mtime == (time_t)-1)
+        rdir->mtime = mtime_asked ? mtime : ftp_listed_dir_mtime(dir);
+    rdir_sort(rdir);
     ftp_trace("added directory '%s' to cache\n", dir);
-    list_additem(ftp->cache, rdir);
+    ftp_cache_add(rdir);
     free(dir);
 
-    rdir_sort(rdir);
     return rdir;
 
 failed: /* forgive me father, for I have goto'ed */
-    if (fp)
-        fclose(fp);
+    if (parser)
+        rdir_parse_end(parser);
+    rdir_destroy(rdir);
     free(dir);
     return NULL;
 }
@@ -1485,15 +1601,160 @@ rdirectory *ftp_get_directory(const char *path)
     ap = ftp_path_absolute(path);
     stripslash(ap);
 
-    rdir = ftp_cache_get_directory(ap);
+    /* the walk is pumped before the lookup, and what it delivers is only
+     * evicted after it, so the directory returned isn't freed meanwhile
+     */
+    ftp_cache_hold();
+    rdir = ftp_walk_wait(ap);
+    if(!rdir)
+        rdir = ftp_cache_get_directory(ap);
+    ftp_cache_release(rdir);
     if(!rdir)
         rdir = ftp_read_directory(ap);
     free(ap);
     return rdir;
 }
 
+/* returns the files in the directory PATH matching MASK, which should
+ * only have the wildcards '*' and '?', as matched by the server with
+ * "LIST MASK"
+ * the result is cached as a view of the directory, apart from the
+ * directory itself
+ * returns 0 if the listing fails or the server doesn't match the mask,
+ * then the whole directory should be read instead
+ */
+rdirectory *ftp_read_directory_matching(const char *path, const char *mask)
+{
+    rdirectory *rdir;
+    rdir_parser *parser;
+    bool _failed;
+    char *dir;
+
+#ifdef HAVE_LIBSSH
+    if(ftp->session)
+        return NULL;
+#endif
+    if(!ftp->has_list_glob)
+        return NULL;
+
+    dir = ftp_path_absolute(path);
+    stripslash(dir);
+
+    rdir = ftp_cache_get_view(dir, mask);
+    if(rdir) {
+        free(dir);
+        return rdir;
+    }
+
+    bool is_curdir = (strcmp(dir, ftp->curdir) == 0);
+
+    rdir = rdir_create();
+
+    if(!is_curdir) {
+        ftp_cmd("CWD %s", dir);
+        if(ftp->code != ctComplete)
+            goto failed;
+    }
+
+    /* MLSD takes no mask, so it is always LIST */
+    parser = rdir_parse_begin(rdir, dir, false);
+    _failed = (ftp_list_stream("LIST", mask, (ftp_list_func)rdir_parse_data,
+                               parser) != 0);
+
+    if(!is_curdir)
+        ftp_cmd("CWD %s", ftp->curdir);
+
+    /* some servers list the contents of matching directories, like
+     * ls -l, with headers that can't be parsed, or after an empty line
+     */
+    if(!_failed && (rdir_parse_failed(parser)
+                    || rdir_parse_truncated(parser))) {
+        ftp_trace("can't parse LIST output for mask '%s'\n", mask);
+        ftp->has_list_glob = false;
+        _failed = true;
+    }
+    if(rdir_parse_end(parser) != 0 || _failed)
+        goto failed;
+
+    /* nothing matched, or the server took the mask as a filename */
+    if(list_numitem(rdir->files) == 0)
+        goto failed;
+
+    /* if the server didn't match the mask, it was probably taken as a
+     * filename or an option, or ignored
+     */
+    for(listitem *li = rdir->files->first; li; li = li->next) {
+        rfile *f = li->data;
+        if(fnmatch(mask, base_name_ptr(f->path), 0) == FNM_NOMATCH) {
+            ftp_trace("server doesn't match LIST masks ('%s' for '%s')\n",
+                      base_name_ptr(f->path), mask);
+            ftp->has_list_glob = false;
+            goto failed;
+        }
+    }
+
+    rdir->filter = xstrdup(mask);
+    rdir_sort(rdir);
+    ftp_trace("added '%s' matching '%s' to cache\n", dir, mask);
+    ftp_cache_add_view(rdir);
+    free(dir);
+
+    return rdir;
+
+failed:
+    rdir_destroy(rdir);
+    free(dir);
+    return NULL;
+}
+
+/* returns true if single files can be looked up with MLST
+ */
+static bool ftp_can_mlst(void)
+{
+#ifdef HAVE_LIBSSH
+    if(ftp->session)
+        return false;
+#endif
+    /* no commands can be sent during a transfer */
+    return ftp->has_mlst_command && !ftp->data;
+}
+
+/* looks up the single file PATH with MLST, into F
+ * returns 0 on success, else -1
+ */
+static int ftp_mlst(const char *path, rfile *f)
+{
+    char *dir;
+    int r;
+
+    if(!ftp_can_mlst())
+        return -1;
+
+    ftp_set_tmp_verbosity(vbNone);
+    ftp_cmd("MLST %s", path);
+    if(ftp->fullcode == 500 || ftp->fullcode == 502) {
+        ftp->has_mlst_command = false;
+        return -1;
+    }
+    if(ftp->code != ctComplete || !ftp->reply_facts)
+        return -1;
+
+    /* type=file;size=3;modify=20010528094249; /path/file */
+    dir = base_dir_xptr(path);
+    r = rfile_parse(f, ftp->reply_facts, dir, true);
+    free(dir);
+    if(r != 0)
+        return -1;
+
+    /* the server might have given another form of the path */
+    free(f->path);
+    f->path = xstrdup(path);
+    return 0;
+}
+
 /* returns the rfile at PATH
- * if it's not in the cache, reads the directory
+ * if it's not in the cache, looks it up with MLST, or reads the
+ * directory if the server doesn't have MLST
  * returns 0 if not found
  */
 rfile *ftp_get_file(const char *path)
@@ -1510,10 +1771,21 @@ rfile *ftp_get_file(const char *path)
     f = ftp_cache_get_file(ap);
     if(!f) {
         char *p = base_dir_xptr(ap);
-        rdirectory *rdir = ftp_get_directory(p);
+        /* if the directory is listed in the cache, the file isn't there */
+        bool known = ftp_cache_has_listing(p);
+        if(!known && ftp_can_mlst() && *base_name_ptr(ap)) {
+            rfile *tmp = rfile_create();
+            if(ftp_mlst(ap, tmp) == 0)
+                f = ftp_cache_add_file(p, tmp);
+            rfile_destroy(tmp);
+            known = (f || ftp->fullcode == 550);
+        }
+        if(!known) {
+            rdirectory *rdir = ftp_get_directory(p);
+            if(rdir)
+                f = rdir_get_file(rdir, base_name_ptr(ap));
+        }
         free(p);
-        if(rdir)
-            f = rdir_get_file(rdir, base_name_ptr(ap));
     }
     free(ap);
     return f;
@@ -1813,6 +2085,36 @@ time_t ftp_filetime(const char *filename, bool force)
   return gmt_mktime(&ts);
 }
 
+/* returns the modification time of the directory PATH, from MLST if
+ * the server has it, else MDTM (which some servers allow on
+ * directories), or -1 if unknown
+ */
+time_t ftp_dir_mtime(const char *path)
+{
+  if (!ftp_connected() || ftp->data)
+    return (time_t)-1;
+
+#ifdef HAVE_LIBSSH
+  if (ftp->session)
+    return ssh_filetime(path);
+#endif
+
+  if (ftp->has_mlst_command)
+  {
+    rfile* f = rfile_create();
+    time_t mtime = (time_t)-1;
+    if (ftp_mlst(path, f) == 0 && f->mtime)
+      mtime = f->mtime;
+    rfile_destroy(f);
+    if (ftp->has_mlst_command)
+      return mtime;
+  }
+
+  if (!ftp->has_dir_mdtm)
+    return (time_t)-1;
+  return ftp_filetime(path, true);
+}
+
 int ftp_maybe_isdir(rfile *fp)
 {
     if(risdir(fp))
@@ -113,10 +113,17 @@ typedef struct transfer_info
 	bool transfer_is_put;        /* true if transfer is put (upload) */
 	bool finished;               /* set when transfer finished */
 	bool begin;
+	size_t chunk_size;           /* size of reads/writes (autotuning) */
+	int sockbuf_size;            /* socket buffer set (autotuning) or 0 */
+	long rtt;                    /* last round trip time (usec) or -1 */
+	bool stall_abort;            /* given up by stall_timeout */
 } transfer_info;
 
 typedef void (*ftp_transfer_func)(transfer_info *ti);
 
+/* gets received data in ftp_list_stream() */
+typedef void (*ftp_list_func)(void *data, const char *buf, size_t len);
+
 typedef struct Ftp
 {
 	Socket *ctrl, *data;
@@ -125,6 +132,8 @@ typedef struct Ftp
 	url_t *url;
 
 	list *cache;             /* list of rdirectory */
+	struct cache_index *cache_index; /* ftp->cache hashed on path */
+	arena *strings;          /* perm, owner and group of cached files */
 	list *dirs_to_flush;     /* list of (char *) */
 
 #ifdef HAVE_LIBSSH
@@ -134,6 +143,7 @@ typedef struct Ftp
 #endif
 
 	char reply[MAXREPLY+1];  /* last reply string from server */
+	char *reply_facts;  /* facts line of the last MLST reply, or 0 */
 
 	code_t code;  /* last reply code (1-5) */
 	int fullcode; /* last reply code (XYZ) */
@@ -155,6 +165,9 @@ typedef struct Ftp
 	bool has_site_chmod_command;
 	bool has_site_idle_command;
 	bool has_mlsd_command;
+	bool has_mlst_command;
+	bool has_dir_mdtm;  /* MDTM works on directories */
+	bool has_list_glob;  /* matches a mask given to LIST */
 
 	long restart_offset;  /* next transfer will be restarted at this offset */
 
@@ -190,6 +203,8 @@ typedef struct Ftp
 	char *last_mkpath; /* used to speed up ftp_mkpath() */
 
 	transfer_info ti;
+	ftp_transfer_func transfer_hook; /* progress callback for ti, or 0 */
+	unsigned int stall_recoveries;   /* transfers resumed after stalling */
 
 } Ftp;
 
@@ -208,6 +223,8 @@ int ftp_set_trace(const char *filename);
 void ftp_reply_timeout(unsigned int secs);
 int ftp_cmd(const char *cmd, ...) YAFC_PRINTF(1, 2);
 int ftp_reopen(void);
+Ftp *ftp_open_clone(void);
+void ftp_close_clone(Ftp *cloneftp);
 int ftp_open_host(Host *hostp);
 int ftp_open_url(url_t *urlp, bool reset_vars);
 int ftp_login(const char *guessed_username, const char *anonpass);
@@ -220,10 +237,15 @@ int ftp_read_reply(void);
 const char *ftp_getreply(bool withcode);
 
 int ftp_list(const char *cmd, const char *param, FILE *fp);
+int ftp_list_stream(const char *cmd, const char *param,
+					ftp_list_func func, void *data);
 int ftp_receive(const char *path, FILE *fp,
 				transfer_mode_t mode, ftp_transfer_func hookf);
 int ftp_getfile(const char *infile, const char *outfile, getmode_t how,
 				transfer_mode_t mode, ftp_transfer_func hookf);
+int ftp_getfile_segmented(const char *infile, const char *outfile,
+						  getmode_t how, transfer_mode_t mode,
+						  unsigned int segments, ftp_transfer_func hookf);
 int ftp_putfile(const char *infile, const char *outfile, putmode_t how,
 				transfer_mode_t mode, ftp_transfer_func hookf);
 int ftp_fxpfile(Ftp *srcftp, const char *srcfile,
@@ -244,15 +266,29 @@ bool ftp_loggedin(void);
 char* ftp_connected_user();
 
 rdirectory *ftp_get_directory(const char *path);
+rdirectory *ftp_read_directory_matching(const char *path, const char *mask);
 rdirectory *ftp_read_directory(const char *path);
 rdirectory *ftp_cache_get_directory(const char *path);
 rfile *ftp_cache_get_file(const char *path);
+bool ftp_cache_has_listing(const char *path);
+rfile *ftp_cache_add_file(const char *dirpath, const rfile *f);
+rdirectory *ftp_cache_get_view(const char *path, const char *filter);
+void ftp_cache_add_view(rdirectory *rdir);
 rfile *ftp_get_file(const char *path);
 void ftp_cache_list_contents(void);
+void ftp_cache_stats(void);
 void ftp_cache_flush_mark(const char *p);
 void ftp_cache_flush_mark_for(const char *p);
 void ftp_cache_flush(void);
 void ftp_cache_clear(void);
+void ftp_cache_add(rdirectory *rdir);
+void ftp_cache_hold(void);
+void ftp_cache_release(const rdirectory *keep);
+void ftp_cache_index_free(struct cache_index *index);
+void ftp_cache_save(void);
+void ftp_cache_load(void);
+int ftp_cache_write_directory(FILE *fp, const rdirectory *rdir);
+rdirectory *ftp_cache_read_directory(const char *buf, size_t len);
 
 char *ftp_getcurdir(void);
 void ftp_update_curdir_x(const char *p);
@@ -266,6 +302,7 @@ int ftp_cdup(void);
 int ftp_unlink(const char *path);
 int ftp_chmod(const char *path, const char *mode);
 time_t ftp_filetime(const char *filename, bool force);
+time_t ftp_dir_mtime(const char *path);
 unsigned long long ftp_filesize(const char *path);
 int ftp_idle(const char *idletime);
 int ftp_noop(void);
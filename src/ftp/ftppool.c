@@ -0,0 +1,201 @@
+/*
+ * ftppool.c -- pool of transfer workers, each with its own session
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+/* Each worker is a forked process with its own logged in session (opened
+ * with ftp_open_clone() before the fork). Workers take the next job from
+ * a counter in shared memory, so jobs are handed out in order, and store
+ * their progress and results there. The parent only waits, sums up the
+ * progress for the transfer hook, and returns the results.
+ */
+
+#include "syshdr.h"
+#include "ftp.h"
+#include "ftppool.h"
+#include "gvars.h"
+#include "xmalloc.h"
+
+typedef struct pool_shared
+{
+	unsigned int next_job;       /* next job to hand out */
+	volatile sig_atomic_t quit;  /* set by parent when interrupted */
+} pool_shared;
+
+/* these live in memory shared with the workers */
+static pool_shared *shared = 0;
+static long long *current = 0;         /* ti.size of each worker's job */
+static ftp_pool_result *results = 0;
+
+static unsigned int this_worker = 0;
+
+static void pool_hook(transfer_info *ti)
+{
+	current[this_worker] = ti->size;
+}
+
+static void pool_worker(unsigned int worker, Ftp *session,
+						unsigned int njobs, ftp_pool_func func, void *data)
+{
+	this_worker = worker;
+	ftp_use(session);
+
+	/* a reply timeout exits through exit_yafc(), which must not quit the
+	 * sessions we share with the parent
+	 */
+	gvFtpList = list_new(0);
+	list_additem(gvFtpList, session);
+	gvCurrentFtp = gvFtpList->first;
+	ftp_set_signal(SIGHUP, SIG_IGN);
+
+	while(!shared->quit && !gvInterrupted) {
+		const unsigned int job = __sync_fetch_and_add(&shared->next_job, 1);
+		if(job >= njobs)
+			break;
+
+		reset_transfer_info();
+		ftp->ti.total_size = 0;
+		current[worker] = 0;
+		const unsigned int recoveries = ftp->stall_recoveries;
+
+		const int r = func(job, data, pool_hook);
+
+		results[job].worker = worker;
+		results[job].size = ftp->ti.size;
+		results[job].total_size = ftp->ti.total_size;
+		results[job].recoveries = ftp->stall_recoveries - recoveries;
+		/* the file actually written, which the server picks for STOU */
+		if(ftp->ti.local_name
+		   && strlen(ftp->ti.local_name) < sizeof(results[job].name))
+			strcpy(results[job].name, ftp->ti.local_name);
+		current[worker] = 0;
+		results[job].status = (r == 0 ? FTP_POOL_OK : FTP_POOL_FAILED);
+	}
+
+	ftp_close_clone(session);
+	_exit(0);
+}
+
+/* runs jobs 0 to NJOBS-1 on WORKERS sessions to the current site,
+ * in parallel; HOOKF (if not 0) gets the progress summed over all jobs
+ * returns a malloc'd array with the result of each job, or 0 if no
+ * worker could be started (the caller should do the jobs itself)
+ */
+ftp_pool_result *ftp_pool_run(unsigned int workers, unsigned int njobs,
+							  ftp_pool_func func, void *data,
+							  const char *remote_name, const char *local_name,
+							  long long total_size, ftp_transfer_func hookf)
+{
+	unsigned int i, n = 0, alive = 0;
+	transfer_info ti;
+
+	if(workers > FTP_POOL_MAX_WORKERS)
+		workers = FTP_POOL_MAX_WORKERS;
+	if(workers > njobs)
+		workers = njobs;
+	if(workers == 0)
+		return 0;
+
+	const size_t len = sizeof(pool_shared) + workers * sizeof(long long)
+		+ njobs * sizeof(ftp_pool_result);
+	void *mem = mmap(0, len, PROT_READ | PROT_WRITE,
+					 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED) {
+		ftp_err("mmap: %s\n", strerror(errno));
+		return 0;
+	}
+	shared = (pool_shared *)mem;
+	current = (long long *)(shared + 1);
+	results = (ftp_pool_result *)(current + workers);
+
+	Ftp **sessions = xmalloc(workers * sizeof(Ftp *));
+	for(i = 0; i < workers && !gvInterrupted; i++) {
+		sessions[n] = ftp_open_clone();
+		if(sessions[n])
+			n++;
+	}
+	if(n < workers)
+		ftp_trace("pool: only %u of %u sessions opened\n", n, workers);
+	if(n == 0) {
+		free(sessions);
+		munmap(mem, len);
+		return 0;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pid_t *pids = xmalloc(n * sizeof(pid_t));
+	for(i = 0; i < n; i++) {
+		pids[i] = fork();
+		if(pids[i] == 0)
+			pool_worker(i, sessions[i], njobs, func, data);
+		if(pids[i] == -1) {
+			perror("fork()");
+			pids[i] = 0;
+			ftp_close_clone(sessions[i]);
+		} else {
+			/* the worker has its own copy, don't QUIT it */
+			ftp_destroy(sessions[i]);
+			alive++;
+		}
+	}
+	free(sessions);
+
+	memset(&ti, 0, sizeof(ti));
+	ti.remote_name = (char *)remote_name;
+	ti.local_name = (char *)local_name;
+	ti.total_size = total_size;
+	ti.begin = true;
+	gettimeofday(&ti.start_time, 0);
+	if(hookf)
+		hookf(&ti);
+	ti.begin = false;
+
+	ftp_set_close_handler();
+	while(alive > 0) {
+		poll(0, 0, ALARM_USEC / 1000);
+
+		if(gvInterrupted && !shared->quit) {
+			shared->quit = 1;
+			ti.interrupted = true;
+		}
+
+		for(i = 0; i < n; i++) {
+			if(pids[i] > 0 && waitpid(pids[i], 0, WNOHANG) == pids[i]) {
+				pids[i] = 0;
+				alive--;
+			}
+		}
+
+		ti.size = 0;
+		for(i = 0; i < njobs; i++) {
+			if(results[i].status != FTP_POOL_NOTRUN)
+				ti.size += results[i].size;
+		}
+		for(i = 0; i < n; i++)
+			ti.size += current[i];
+
+		if(hookf && alive > 0)
+			hookf(&ti);
+	}
+	free(pids);
+
+	ti.finished = true;
+	if(hookf)
+		hookf(&ti);
+
+	ftp_pool_result *ret = xmalloc(njobs * sizeof(ftp_pool_result));
+	memcpy(ret, results, njobs * sizeof(ftp_pool_result));
+	munmap(mem, len);
+	shared = 0;
+	current = 0;
+	results = 0;
+
+	return ret;
+}
@@ -0,0 +1,50 @@
+/*
+ * ftppool.h -- pool of transfer workers, each with its own session
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+#ifndef _ftppool_h_included
+#define _ftppool_h_included
+
+#include "ftp.h"
+
+#define FTP_POOL_NAME_MAX 512
+
+/* most sessions opened at once for one transfer */
+#define FTP_POOL_MAX_WORKERS 32
+
+/* result of one job */
+typedef struct ftp_pool_result
+{
+	int status;             /* one of the FTP_POOL_* values below */
+	unsigned int worker;    /* worker that ran the job */
+	long long size;         /* bytes transferred (ti.size) */
+	long long total_size;   /* size of file (ti.total_size) */
+	unsigned int recoveries; /* times the job was resumed after stalling */
+	char name[FTP_POOL_NAME_MAX]; /* ti.local_name, or "" if it didn't fit */
+} ftp_pool_result;
+
+#define FTP_POOL_NOTRUN 0   /* job was never started (interrupted) */
+#define FTP_POOL_OK 1
+#define FTP_POOL_FAILED 2
+
+/* called in a worker process for job number JOB, with the worker's
+ * session in use (the global ftp); HOOKF should be passed on as the
+ * transfer hook, so progress is reported back
+ * returns 0 on success, else -1
+ */
+typedef int (*ftp_pool_func)(unsigned int job, void *data,
+							 ftp_transfer_func hookf);
+
+ftp_pool_result *ftp_pool_run(unsigned int workers, unsigned int njobs,
+							  ftp_pool_func func, void *data,
+							  const char *remote_name, const char *local_name,
+							  long long total_size, ftp_transfer_func hookf);
+
+#endif
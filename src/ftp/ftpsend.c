@@ -272,8 +272,6 @@ int ftp_type(transfer_mode_t type)
 	return 0;
 }
 
-static ftp_transfer_func foo_hookf = 0;
-
 /* abort routine originally from Cftp by Dieter Baron
  */
 int ftp_abort(Socket* fp)
@@ -291,6 +289,9 @@ int ftp_abort(Socket* fp)
 
 	ftp_set_close_handler();
 
+	/* the data connection may be non-blocking, but it must be drained */
+	sock_set_nonblocking(fp, false);
+
 	if (sock_check_pending(fp, false) == 1) {
 		ftp_trace("There is data on the control channel, won't send ABOR\n");
 		/* read remaining bytes from connection */
@@ -335,6 +336,35 @@ int ftp_abort(Socket* fp)
 	return -1;
 }
 
+/* how many times a stalled transfer is resumed */
+#define FTP_STALL_RETRIES 5
+
+static time_t stall_then;  /* 0 unless watching a file transfer */
+static long long stall_size;
+
+/* returns true if less than stall_min_rate bytes/s went through during the
+ * last stall_timeout seconds, and marks the transfer as given up
+ */
+static bool data_stalled(void)
+{
+	if(gvStallTimeout == 0 || stall_then == 0)
+		return false;
+
+	const time_t now = time(0);
+	if(now - stall_then < (time_t)gvStallTimeout)
+		return false;
+	if(ftp->ti.size - stall_size
+	   < (long long)gvStallMinRate * gvStallTimeout) {
+		ftp_err(_("less than %u bytes/s for %u seconds, transfer stalled\n"),
+				gvStallMinRate, gvStallTimeout);
+		ftp->ti.stall_abort = true;
+		return true;
+	}
+	stall_then = now;
+	stall_size = ftp->ti.size;
+	return false;
+}
+
 static int wait_for_data(Socket* fp, bool wait_for_read)
 {
   errno = 0;
@@ -377,8 +407,10 @@ static int wait_for_input(void)
 				ftp->ti.interrupted = true;
 			return -1;
 		}
-		if(r == 0 && foo_hookf)
-			foo_hookf(&ftp->ti);
+		if(r == 0 && data_stalled())
+			return -1;
+		if(r == 0 && ftp->transfer_hook)
+			ftp->transfer_hook(&ftp->ti);
 	} while(r == 0);
 
 	return 0;
@@ -391,13 +423,131 @@ static int wait_for_output(void)
 		r = wait_for_data(ftp->data, false);
 		if(r == -1)
 			return -1;
-		if(r == 0 && foo_hookf)
-			foo_hookf(&ftp->ti);
+		if(r == 0 && data_stalled())
+			return -1;
+		if(r == 0 && ftp->transfer_hook)
+			ftp->transfer_hook(&ftp->ti);
 	} while(r == 0);
 
 	return 0;
 }
 
+/* the data connection is non-blocking during transfers, so the I/O is
+ * tried first and we only wait (in poll, woken by signals) when it
+ * returns EAGAIN; call this with the result R of that read or write
+ * returns 1 if it should be tried again, -1 if the transfer should stop,
+ * and 0 if R is to be handled as usual
+ */
+static int data_again(ssize_t r, bool input)
+{
+	if(r > 0) {
+		ftp->ti.stalled = 0;
+		/* a slow trickle counts as stalled too */
+		return data_stalled() ? -1 : 0;
+	}
+	if(r == 0)
+		return 0;
+	if(errno == EINTR)
+		return ftp_sigints() > 0 || gvInterrupted ? -1 : 1;
+	if(errno != EAGAIN && errno != EWOULDBLOCK)
+		return 0;
+	return (input ? wait_for_input() : wait_for_output()) == 0 ? 1 : -1;
+}
+
+/* largest read/write size autotuning will choose */
+#define FTP_CHUNK_MAX (1024 * 1024)
+
+static time_t tune_then;
+static long long tune_size;
+static int tune_sockbuf;
+
+/* starts the stall watch and autotuning of the data connection buffers
+ * for a transfer, if they're enabled
+ */
+static void data_begin(void)
+{
+	stall_then = time(0);
+	stall_size = ftp->ti.size;
+	ftp->ti.chunk_size = FTP_BUFSIZ;
+	ftp->ti.sockbuf_size = 0;
+	ftp->ti.rtt = -1;
+	tune_then = time(0);
+	tune_size = ftp->ti.size;
+	tune_sockbuf = 0;
+}
+
+/* size of the buffer the transfer loops need for ti.chunk_size */
+static size_t data_chunk_max(void)
+{
+	const size_t max = (size_t)gvAutotuneBufferMax * 1024;
+	if(max <= FTP_BUFSIZ)
+		return FTP_BUFSIZ;
+	return max < FTP_CHUNK_MAX ? max : FTP_CHUNK_MAX;
+}
+
+/* called after each read or write on SOCK; about once a second grows
+ * ti.chunk_size and the socket buffers to what the throughput since the
+ * last time and the round trip time call for, up to autotune_buffer_max
+ */
+static void data_tune(Socket *sock)
+{
+	if(gvAutotuneBufferMax == 0)
+		return;
+
+	const time_t now = time(0);
+	if(now <= tune_then)
+		return;
+	const long long rate = (ftp->ti.size - tune_size) / (now - tune_then);
+	tune_then = now;
+	tune_size = ftp->ti.size;
+
+	/* about 10 ms worth of data per read or write */
+	size_t chunk = ftp->ti.chunk_size;
+	while(chunk < rate / 100 && chunk * 2 <= data_chunk_max())
+		chunk *= 2;
+	if(chunk != ftp->ti.chunk_size) {
+		ftp_trace("autotune: reads/writes of %lu bytes (%lld B/s)\n",
+				  (unsigned long)chunk, rate);
+		ftp->ti.chunk_size = chunk;
+	}
+
+	/* twice the bandwidth-delay product, so the window is no limit */
+	const long rtt = sock_rtt(sock);
+	if(rtt <= 0)
+		return;
+	ftp->ti.rtt = rtt;
+	long long want = 2 * rate * rtt / 1000000;
+	if(want > (long long)gvAutotuneBufferMax * 1024)
+		want = (long long)gvAutotuneBufferMax * 1024;
+	if(want > FTP_BUFSIZ && want > tune_sockbuf + tune_sockbuf / 4) {
+		const int r = sock_set_bufsize(sock, (int)want);
+		tune_sockbuf = (int)want;
+		if(r > 0 && r != ftp->ti.sockbuf_size) {
+			ftp_trace("autotune: socket buffers of %d bytes (rtt %ld us, %lld B/s)\n",
+					  r, rtt, rate);
+			ftp->ti.sockbuf_size = r;
+		}
+	}
+}
+
+/* writes all N bytes in BUF to the data connection
+ * returns 0 on success, else -1
+ */
+static int data_write(Socket *out, const char *buf, size_t n)
+{
+	while(n > 0) {
+		const ssize_t w = sock_write(out, buf, n);
+		const int a = data_again(w, false);
+		if(a == 1)
+			continue;
+		if(a == -1 || w <= 0)
+			return -1;
+		buf += w;
+		n -= w;
+	}
+	return 0;
+}
+
 static int maybe_abort_in(Socket* in, FILE *out)
 {
 	unsigned int i = ftp_sigints();
@@ -405,15 +555,19 @@ static int maybe_abort_in(Socket* in, FILE *out)
 
 	ftp->ti.finished = true;
 
+	/* leave it to stall_reopen(), the server may not answer */
+	if(ftp->ti.stall_abort)
+		return -1;
+
 	if(ftp->ti.interrupted)
 		i++;
 
-	if(i > 0 || sock_error_in(in) || ferror(out)) {
+	if(i > 0 || sock_error_in(in) || (out && ferror(out))) {
 		if(sock_error_in(in)) {
 			ftp_err(_("read error: %s\n"), strerror(errno));
 			ftp->ti.ioerror = true;
 		}
-		else if(ferror(out)) {
+		else if(out && ferror(out)) {
 			ftp_err(_("write error: %s\n"), strerror(errno));
 			ftp->ti.ioerror = true;
 		}
@@ -429,6 +583,10 @@ static int maybe_abort_out(FILE *in, Socket *out)
 
 	ftp->ti.finished = true;
 
+	/* leave it to stall_reopen(), the server may not answer */
+	if(ftp->ti.stall_abort)
+		return -1;
+
 	if(ftp->ti.interrupted)
 		i++;
 
@@ -446,6 +604,71 @@ static int maybe_abort_out(FILE *in, Socket *out)
 	return 0;
 }
 
+/* bytes handed to sock_sendfile() and sock_recvfile() at a time, small
+ * enough to keep the progress and SIGINT checks going
+ */
+#define FTP_SENDFILE_SIZE (256 * 1024)
+
+/* receives IN into OUT with sock_recvfile(), without copying it through
+ * us; only done for regular files not opened for appending
+ * returns 1 if it can't be done and nothing was received, else 0
+ */
+static int FILE_recvfile(Socket* in, FILE *out)
+{
+	time_t then = time(0) - 1;
+	time_t now;
+	struct stat sb;
+	bool received = false;
+	const int fd = fileno(out);
+
+	if(fd == -1 || fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode))
+		return 1;
+	/* splice(2) refuses O_APPEND, and then the bytes are already read */
+	const int fl = fcntl(fd, F_GETFL);
+	if(fl == -1 || (fl & O_APPEND))
+		return 1;
+	if(fflush(out) != 0)
+		return 1;
+
+	while(true) {
+		ssize_t n = sock_recvfile(in, fd, FTP_SENDFILE_SIZE);
+		const int a = data_again(n, true);
+		if(a == 1)
+			continue;
+		if(a == -1) {
+			ftp_trace("wait_for_input() returned non-zero\n");
+			break;
+		}
+		if(n == -1) {
+			if(!received && (errno == ENOSYS || errno == EINVAL))
+				return 1;
+			ftp_err(_("write error: %s\n"), strerror(errno));
+			ftp->ti.ioerror = true;
+			break;
+		}
+		if(n == 0)
+			break;
+		received = true;
+
+		if(ftp_sigints() > 0) {
+			ftp_trace("break due to sigint\n");
+			break;
+		}
+
+		ftp->ti.size += n;
+		data_tune(in);
+		if(ftp->transfer_hook) {
+			now = time(0);
+			if(now > then) {
+				ftp->transfer_hook(&ftp->ti);
+				then = now;
+			}
+		}
+	}
+
+	return 0;
+}
+
 static int FILE_recv_binary(Socket* in, FILE *out)
 {
 	time_t then = time(0) - 1;
@@ -453,21 +676,28 @@ static int FILE_recv_binary(Socket* in, FILE *out)
 
 	ftp_set_close_handler();
 
-	if(foo_hookf)
-		foo_hookf(&ftp->ti);
+	if(ftp->transfer_hook)
+		ftp->transfer_hook(&ftp->ti);
 	ftp->ti.begin = false;
 
 	sock_clearerr_in(in);
 	clearerr(out);
 
-	char* buf = xmalloc(FTP_BUFSIZ);
+	if(FILE_recvfile(in, out) == 0) {
+		ftp_set_close_handler();
+		return maybe_abort_in(in, out);
+	}
+
+	char* buf = xmalloc(data_chunk_max());
 	while (!sock_eof(in)) {
-		if(wait_for_input() != 0) {
+    const ssize_t n = sock_read(in, buf, ftp->ti.chunk_size);
+		const int a = data_again(n, true);
+		if(a == 1)
+			continue;
+		if(a == -1) {
 			ftp_trace("wait_for_input() returned non-zero\n");
 			break;
 		}
-
-    const ssize_t n = sock_read(in, buf, FTP_BUFSIZ);
 		if (n <= 0)
 			break;
 
@@ -480,11 +710,12 @@ static int FILE_recv_binary(Socket* in, FILE *out)
 			break;
 
 		ftp->ti.size += n;
+		data_tune(in);
 
-		if(foo_hookf) {
+		if(ftp->transfer_hook) {
 			now = time(0);
 			if(now > then) {
-				foo_hookf(&ftp->ti);
+				ftp->transfer_hook(&ftp->ti);
 				then = now;
 			}
 		}
@@ -496,6 +727,54 @@ static int FILE_recv_binary(Socket* in, FILE *out)
 	return maybe_abort_in(in, out);
 }
 
+/* sends IN to OUT with sock_sendfile(), without copying it through us
+ * returns 1 if OUT (or IN) can't do that and nothing was sent, else 0
+ */
+static int FILE_sendfile(FILE *in, Socket *out)
+{
+	time_t then = time(0) - 1;
+	time_t now;
+	off_t offset = ftello(in);
+	bool sent = false;
+
+	if(offset == -1)
+		return 1;
+
+	while(true) {
+		if(ftp_sigints() > 0)
+			break;
+
+		ssize_t n = sock_sendfile(out, fileno(in), &offset, FTP_SENDFILE_SIZE);
+		const int a = data_again(n, false);
+		if(a == 1)
+			continue;
+		if(a == -1)
+			break;
+		if(n == -1) {
+			if(!sent && (errno == ENOSYS || errno == EINVAL))
+				return 1;
+			ftp_err(_("write error: %s\n"), strerror(errno));
+			ftp->ti.ioerror = true;
+			break;
+		}
+		if(n == 0)
+			break;
+		sent = true;
+
+		ftp->ti.size += n;
+		data_tune(out);
+		if(ftp->transfer_hook) {
+			now = time(0);
+			if(now > then) {
+				ftp->transfer_hook(&ftp->ti);
+				then = now;
+			}
+		}
+	}
+
+	return 0;
+}
+
 static int FILE_send_binary(FILE *in, Socket *out)
 {
 	time_t then = time(0) - 1;
@@ -503,32 +782,33 @@ static int FILE_send_binary(FILE *in, Socket *out)
 
 	ftp_set_close_handler();
 
-	if(foo_hookf)
-		foo_hookf(&ftp->ti);
+	if(ftp->transfer_hook)
+		ftp->transfer_hook(&ftp->ti);
 	ftp->ti.begin = false;
 
 	clearerr(in);
 	sock_clearerr_out(out);
 
-	char* buf = xmalloc(FTP_BUFSIZ);
+	if(FILE_sendfile(in, out) == 0)
+		return maybe_abort_out(in, out);
+
+	char* buf = xmalloc(data_chunk_max());
 	while(!feof(in)) {
-		ssize_t n = fread(buf, sizeof(char), FTP_BUFSIZ, in);
+		ssize_t n = fread(buf, sizeof(char), ftp->ti.chunk_size, in);
 		if(n <= 0)
 			break;
 
 		if(ftp_sigints() > 0)
 			break;
 
-		if(wait_for_output() != 0)
+		if(data_write(out, buf, n) != 0)
 			break;
-
-    if (sock_write(out, buf, n) != n)
-      break;
 		ftp->ti.size += n;
-		if(foo_hookf) {
+		data_tune(out);
+		if(ftp->transfer_hook) {
 			now = time(0);
 			if(now > then) {
-				foo_hookf(&ftp->ti);
+				ftp->transfer_hook(&ftp->ti);
 				then = now;
 			}
 		}
@@ -539,68 +819,162 @@ static int FILE_send_binary(FILE *in, Socket *out)
 	return maybe_abort_out(in, out);
 }
 
-static int FILE_recv_ascii(Socket* in, FILE *out)
+/* size of the blocks read in ASCII transfers */
+#define FTP_ASCII_BUFSIZ (64 * 1024)
+
+/* converts CRLF to LF in the N bytes in BUF, in place, and adds the number
+ * of LFs without a CR to *BARELFS; the memchr() scans do the bulk of the
+ * work, a byte at a time is only handled at each CR
+ * a CR last in BUF is left out and *CR set, as its LF may be in the
+ * next block
+ * returns the converted length
+ */
+static size_t ascii_from_crlf(char *buf, size_t n, bool *cr,
+							  unsigned *barelfs)
+{
+	char *src = buf, *dst = buf;
+	char *const end = buf + n;
+
+	*cr = false;
+	while(src < end) {
+		char *e = memchr(src, '\r', end - src);
+		char *stop = e ? e : end;
+
+		/* no CR up to stop, so all LFs here are bare */
+		char *lf = src;
+		while((lf = memchr(lf, '\n', stop - lf)) != 0) {
+			(*barelfs)++;
+			lf++;
+		}
+
+		if(dst != src)
+			memmove(dst, src, stop - src);
+		dst += stop - src;
+
+		if(!e)
+			break;
+		if(e + 1 == end) {
+			*cr = true;
+			break;
+		}
+		if(e[1] == '\n') {
+			*dst++ = '\n';
+			src = e + 2;
+		} else {
+			*dst++ = '\r';
+			src = e + 1;
+		}
+	}
+
+	return dst - buf;
+}
+
+/* receives in ASCII mode, written to OUT or, if OUT is 0, passed to FUNC
+ * a block at a time
+ */
+static int recv_ascii(Socket* in, FILE *out, ftp_list_func func, void *data)
 {
 	time_t then = time(0) - 1;
 	time_t now;
+	bool cr = false, eof = false;
 
 	ftp_set_close_handler();
 
-	if(foo_hookf)
-		foo_hookf(&ftp->ti);
+	if(ftp->transfer_hook)
+		ftp->transfer_hook(&ftp->ti);
 	ftp->ti.begin = false;
 
 	sock_clearerr_in(in);
-	clearerr(out);
-
-  bool next = true;
-  int nc = 0;
-	while (true)
-  {
-    int c = 0;
-    if (next)
-    {
-      c = sock_get(in);
-      if (c == EOF)
-        break;
-    }
-    else
-    {
-      c = nc;
-      next = true;
-    }
+	if(out)
+		clearerr(out);
+
+	/* one byte in front for a CR held back from the previous block */
+	char* buf = xmalloc(FTP_ASCII_BUFSIZ + 1);
+	while(true) {
+		ssize_t n = sock_read(in, buf + 1, FTP_ASCII_BUFSIZ);
+		const int a = data_again(n, true);
+		if(a == 1)
+			continue;
+		if(a == -1) {
+			ftp_trace("wait_for_input() returned non-zero\n");
+			break;
+		}
+		if(n == 0)
+			eof = true;
+		if(n <= 0)
+			break;
 
-		if (ftp_sigints() > 0 || wait_for_input() != 0)
+		if(ftp_sigints() > 0) {
+			ftp_trace("break due to sigint\n");
 			break;
+		}
 
-		if (c == '\n')
-			ftp->ti.barelfs++;
-		else if (c == '\r')
-    {
-			nc = sock_get(in);
-			if (nc == EOF)
-				break;
-			if (nc != '\n')
-        next = false;
-      else
-        c = nc;
+		char *p = buf + 1;
+		if(cr) {
+			*--p = '\r';
+			n++;
 		}
-		if (fputc(c, out) == EOF)
+		const size_t len = ascii_from_crlf(p, n, &cr, &ftp->ti.barelfs);
+		if(!out)
+			func(data, p, len);
+		else if(fwrite(p, sizeof(char), len, out) != len)
 			break;
 
-		ftp->ti.size++;
-		if(foo_hookf) {
+		ftp->ti.size += len;
+		data_tune(in);
+		if(ftp->transfer_hook) {
 			now = time(0);
 			if(now > then) {
-				foo_hookf(&ftp->ti);
+				ftp->transfer_hook(&ftp->ti);
 				then = now;
 			}
 		}
 	}
+	free(buf);
+
+	/* a lone CR at the very end */
+	if(eof && cr) {
+		if(!out) {
+			func(data, "\r", 1);
+			ftp->ti.size++;
+		} else if(fputc('\r', out) != EOF)
+			ftp->ti.size++;
+	}
 
 	return maybe_abort_in(in, out);
 }
 
+static int FILE_recv_ascii(Socket* in, FILE *out)
+{
+	return recv_ascii(in, out, 0, 0);
+}
+
+/* copies the N bytes in BUF to OBUF (which must have room for 2*N bytes)
+ * with each LF expanded to CRLF, finding the LFs with memchr()
+ * returns the length of OBUF
+ */
+static size_t ascii_to_crlf(const char *buf, size_t n, char *obuf)
+{
+	const char *src = buf;
+	const char *const end = buf + n;
+	char *dst = obuf;
+
+	while(src < end) {
+		const char *lf = memchr(src, '\n', end - src);
+		const char *stop = lf ? lf : end;
+
+		memcpy(dst, src, stop - src);
+		dst += stop - src;
+		if(!lf)
+			break;
+		*dst++ = '\r';
+		*dst++ = '\n';
+		src = lf + 1;
+	}
+
+	return dst - obuf;
+}
+
 static int FILE_send_ascii(FILE* in, Socket* out)
 {
 	time_t then = time(0) - 1;
@@ -608,37 +982,40 @@ static int FILE_send_ascii(FILE* in, Socket* out)
 
 	ftp_set_close_handler();
 
-	if(foo_hookf)
-		foo_hookf(&ftp->ti);
+	if(ftp->transfer_hook)
+		ftp->transfer_hook(&ftp->ti);
 	ftp->ti.begin = false;
 
 	clearerr(in);
 	sock_clearerr_out(out);
 
-  int c;
-	while((c = fgetc(in)) != EOF) {
-		if(ftp_sigints() > 0)
+	/* every byte may become two */
+	char* buf = xmalloc(FTP_ASCII_BUFSIZ);
+	char* obuf = xmalloc(2 * FTP_ASCII_BUFSIZ);
+	while(!feof(in)) {
+		const size_t n = fread(buf, sizeof(char), FTP_ASCII_BUFSIZ, in);
+		if(n == 0)
 			break;
 
-		if(wait_for_output() != 0)
+		if(ftp_sigints() > 0)
 			break;
 
-		if(c == '\n') {
-			if(sock_put(out, '\r') == EOF)
-				break;
-			ftp->ti.size++;
-		}
-		if(sock_put(out, c) == EOF)
+		const size_t len = ascii_to_crlf(buf, n, obuf);
+		if(data_write(out, obuf, len) != 0)
 			break;
-		ftp->ti.size++;
-		if(foo_hookf) {
+		/* the CRs added are counted too */
+		ftp->ti.size += len;
+		data_tune(out);
+		if(ftp->transfer_hook) {
 			now = time(0);
 			if(now > then) {
-				foo_hookf(&ftp->ti);
+				ftp->transfer_hook(&ftp->ti);
 				then = now;
 			}
 		}
 	}
+	free(obuf);
+	free(buf);
 
 	return maybe_abort_out(in, out);
 }
@@ -654,6 +1031,11 @@ void reset_transfer_info(void)
 	ftp->ti.finished = false;
 	ftp->ti.stalled = 0;
 	ftp->ti.begin = true;
+	ftp->ti.chunk_size = 0;
+	ftp->ti.sockbuf_size = 0;
+	ftp->ti.rtt = -1;
+	ftp->ti.stall_abort = false;
+	stall_then = 0;
 	gettimeofday(&ftp->ti.start_time, 0);
 	if(!ftp->ti.local_name)
 		ftp->ti.local_name = xstrdup("local");
@@ -661,18 +1043,11 @@ void reset_transfer_info(void)
 		ftp->ti.remote_name = xstrdup("remote");
 }
 
-int ftp_list(const char *cmd, const char *param, FILE *fp)
+static int list_common(const char *cmd, const char *param, FILE *fp,
+                       ftp_list_func func, void *data)
 {
-  if (!cmd || !fp || !ftp_connected())
-    return -1;
-
-#ifdef HAVE_LIBSSH
-  if (ftp->session)
-    return ssh_list(cmd, param, fp);
-#endif
-
   reset_transfer_info();
-  foo_hookf = NULL;
+  ftp->transfer_hook = NULL;
 
 #if 0 /* don't care about transfer type, binary should work well... */
   ftp_type(tmAscii);
@@ -689,15 +1064,15 @@ int ftp_list(const char *cmd, const char *param, FILE *fp)
   else
     ftp_cmd("%s", cmd);
   if (ftp->code != ctPrelim)
-    return -1;
+    goto failed;
 
   if (!sock_accept(ftp->data, "r", ftp_is_passive())) {
     perror("accept()");
-    return -1;
+    goto failed;
   }
 
-  if (FILE_recv_ascii(ftp->data, fp) != 0)
-    return -1;
+  if (recv_ascii(ftp->data, fp, func, data) != 0)
+    goto failed;
 
   sock_destroy(ftp->data);
   ftp->data = NULL;
@@ -705,13 +1080,49 @@ int ftp_list(const char *cmd, const char *param, FILE *fp)
   ftp_read_reply();
 
   return ftp->code == ctComplete ? 0 : -1;
+
+failed:
+  /* so no transfer looks like it is still going on */
+  sock_destroy(ftp->data);
+  ftp->data = NULL;
+  return -1;
+}
+
+int ftp_list(const char *cmd, const char *param, FILE *fp)
+{
+  if (!cmd || !fp || !ftp_connected())
+    return -1;
+
+#ifdef HAVE_LIBSSH
+  if (ftp->session)
+    return ssh_list(cmd, param, fp);
+#endif
+
+  return list_common(cmd, param, fp, 0, 0);
+}
+
+/* like ftp_list(), but the listing is passed to FUNC a block at a time
+ * while it is received, instead of written to a file
+ */
+int ftp_list_stream(const char *cmd, const char *param,
+                    ftp_list_func func, void *data)
+{
+  if (!cmd || !func || !ftp_connected())
+    return -1;
+
+#ifdef HAVE_LIBSSH
+  if (ftp->session)
+    return -1;
+#endif
+
+  return list_common(cmd, param, 0, func, data);
 }
 
 void transfer_finished(void)
 {
 	ftp->ti.finished = true;
-	if(foo_hookf)
-		foo_hookf(&ftp->ti);
+	if(ftp->transfer_hook)
+		ftp->transfer_hook(&ftp->ti);
 }
 
 static int ftp_init_receive(const char *path, transfer_mode_t mode,
@@ -722,7 +1133,7 @@ static int ftp_init_receive(const char *path, transfer_mode_t mode,
 
 	ftp->restart_offset = 0L;
 
-	foo_hookf = hookf;
+	ftp->transfer_hook = hookf;
 	reset_transfer_info();
 
 	if(ftp_init_transfer() != 0)
@@ -777,6 +1188,8 @@ static int ftp_do_receive(FILE *fp,
 {
 	int r;
 
+	sock_set_nonblocking(ftp->data, true);
+	data_begin();
 	if(mode == tmBinary)
 		r = FILE_recv_binary(ftp->data, fp);
 	else
@@ -896,10 +1309,13 @@ static int ftp_send(const char *path, FILE *fp, putmode_t how,
 
 	ftp_cache_flush_mark_for(path);
 
+	sock_set_nonblocking(ftp->data, true);
+	data_begin();
 	if(mode == tmBinary)
 		r = FILE_send_binary(fp, ftp->data);
 	else
 		r = FILE_send_ascii(fp, ftp->data);
+	sock_set_nonblocking(ftp->data, false);
 	sock_flush(ftp->data);
 	sock_destroy(ftp->data);
 	ftp->data = 0;
@@ -1057,8 +1473,39 @@ int ftp_fxpfile(Ftp *srcftp, const char *srcfile,
 	return r;
 }
 
-int ftp_getfile(const char *infile, const char *outfile, getmode_t how,
-				transfer_mode_t mode, ftp_transfer_func hookf)
+/* gives up a stalled transfer: ABOR is sent but not waited for, as the
+ * control connection is likely stuck as well, both connections are
+ * dropped and the session is opened and logged in again
+ * returns 0 on success, else -1
+ */
+static int stall_reopen(void)
+{
+	ftp_err(_("Reconnecting to resume stalled transfer...\n"));
+
+	if(sock_connected(ftp->ctrl)) {
+		sock_telnet_interrupt(ftp->ctrl);
+		sock_krb_printf(ftp->ctrl, "ABOR");
+		sock_printf(ftp->ctrl, "\r\n");
+		sock_flush(ftp->ctrl);
+	}
+	sock_destroy(ftp->data);
+	ftp->data = 0;
+	sock_destroy(ftp->ctrl);
+	ftp->ctrl = 0;
+	ftp->connected = false;
+	ftp->loggedin = false;
+
+	if(ftp_reopen() != 0 || !ftp_loggedin())
+		return -1;
+
+	ftp->stall_recoveries++;
+	stats_recovery(1);
+	return 0;
+}
+
+static int getfile_once(const char *infile, const char *outfile,
+						getmode_t how, transfer_mode_t mode,
+						ftp_transfer_func hookf)
 {
 	FILE *fp;
 	int r;
@@ -1138,7 +1585,7 @@ int ftp_getfile(const char *infile, const char *outfile, getmode_t how,
 	ftp->ti.remote_name = xstrdup(infile);
 	ftp->ti.local_name = xstrdup(outfile);
 
-	foo_hookf = hookf;
+	ftp->transfer_hook = hookf;
 
 #ifdef HAVE_LIBSSH
 	if(ftp->session)
@@ -1150,8 +1597,314 @@ int ftp_getfile(const char *infile, const char *outfile, getmode_t how,
 	return r;
 }
 
-int ftp_putfile(const char *infile, const char *outfile, putmode_t how,
+int ftp_getfile(const char *infile, const char *outfile, getmode_t how,
 				transfer_mode_t mode, ftp_transfer_func hookf)
+{
+	unsigned int n = 0;
+	int r = getfile_once(infile, outfile, how, mode, hookf);
+
+	/* REST offsets are only reliable for binary transfers */
+	while(r != 0 && ftp->ti.stall_abort && mode == tmBinary
+		  && (how == getNormal || how == getResume)
+		  && n++ < FTP_STALL_RETRIES && stall_reopen() == 0)
+		r = getfile_once(infile, outfile, getResume, mode, hookf);
+
+	return r;
+}
+
+/* segmented download: the remote file is split into disjoint byte ranges,
+ * each one fetched with REST/RETR over an extra session and written in
+ * place with pwrite()
+ */
+
+/* don't open an extra connection for less than this */
+#define FTP_MIN_SEGMENT (1024 * 1024)
+
+typedef struct segment
+{
+	Ftp *ftp;            /* extra session carrying this segment, or 0 */
+	long long offset;    /* start of segment in remote file */
+	long long length;    /* size of segment in bytes */
+	long long done;      /* bytes received so far */
+} segment;
+
+/* opens the data connection for the not yet received part of SEG
+ */
+static int segment_start(segment *seg, const char *path)
+{
+	Ftp *thisftp = ftp;
+	long long rp = seg->offset + seg->done;
+
+	ftp_use(seg->ftp);
+	int r = ftp_init_transfer();
+	if(r == 0)
+		r = ftp_type(tmBinary);
+	if(r == 0 && rp > 0) {
+		ftp_cmd("REST %lld", rp);
+		if(ftp->code != ctContinue)
+			r = -1;
+	}
+	if(r == 0) {
+		ftp_cmd("RETR %s", path);
+		if(ftp->code != ctPrelim)
+			r = -1;
+	}
+	if(r == 0 && !sock_accept(ftp->data, "r", ftp_is_passive()))
+		r = -1;
+	if(r != 0) {
+		sock_destroy(ftp->data);
+		ftp->data = NULL;
+	}
+	ftp_use(thisftp);
+
+	return r;
+}
+
+static void segment_close(segment *seg)
+{
+	if(!seg->ftp)
+		return;
+
+	/* the server gets an error when we close the data connection before
+	 * the end of file, that's fine since we QUIT right away
+	 */
+	sock_destroy(seg->ftp->data);
+	seg->ftp->data = NULL;
+	ftp_close_clone(seg->ftp);
+	seg->ftp = 0;
+}
+
+static int pwrite_all(int fd, const char *buf, size_t n, off_t offset)
+{
+	while(n > 0) {
+		const ssize_t w = pwrite(fd, buf, n, offset);
+		if(w <= 0)
+			return -1;
+		buf += w;
+		n -= w;
+		offset += w;
+	}
+	return 0;
+}
+
+/* receives the unfinished segments in SEGS, all in parallel
+ * returns 0 if every segment is complete
+ */
+static int recv_segments(segment *segs, unsigned int n, const char *path,
+						 int fd)
+{
+	unsigned int i;
+	time_t then = time(0) - 1;
+	time_t now;
+	int r = 0;
+
+	for(i = 0; i < n && !gvInterrupted; i++) {
+		if(segs[i].done == segs[i].length)
+			continue;
+		segs[i].ftp = ftp_open_clone();
+		if(segs[i].ftp && segment_start(&segs[i], path) != 0)
+			segment_close(&segs[i]);
+		if(!segs[i].ftp)
+			ftp_trace("segment %u: unable to start transfer\n", i);
+	}
+
+	ftp_set_close_handler();
+
+	struct pollfd *pfds = xmalloc(n * sizeof(struct pollfd));
+	char *buf = xmalloc(FTP_BUFSIZ);
+	while(true) {
+		unsigned int active = 0;
+
+		for(i = 0; i < n; i++) {
+			pfds[i].fd = segs[i].ftp ? sock_handle(segs[i].ftp->data) : -1;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+			if(pfds[i].fd != -1)
+				active++;
+		}
+		if(active == 0)
+			break;
+
+		const int p = poll(pfds, n, ALARM_USEC / 1000);
+		if(ftp_sigints() > 0 || gvInterrupted) {
+			ftp->ti.interrupted = true;
+			break;
+		}
+		if(p < 0) {
+			if(errno == EINTR)
+				continue;
+			ftp_err("poll: %s\n", strerror(errno));
+			break;
+		}
+		if(p == 0)
+			ftp->ti.stalled++;
+		else
+			ftp->ti.stalled = 0;
+
+		for(i = 0; i < n; i++) {
+			segment *seg = &segs[i];
+
+			if(pfds[i].fd == -1 || pfds[i].revents == 0)
+				continue;
+
+			const long long left = seg->length - seg->done;
+			const ssize_t got = sock_read(seg->ftp->data, buf,
+										  left < FTP_BUFSIZ ? left : FTP_BUFSIZ);
+			if(got > 0) {
+				if(pwrite_all(fd, buf, got, seg->offset + seg->done) != 0) {
+					ftp_err(_("write error: %s\n"), strerror(errno));
+					ftp->ti.ioerror = true;
+					break;
+				}
+				seg->done += got;
+				ftp->ti.size += got;
+			}
+
+			if(got <= 0 || seg->done == seg->length) {
+				if(seg->done != seg->length)
+					ftp_trace("segment %u: connection lost after %lld of %lld"
+							  " bytes\n", i, seg->done, seg->length);
+				/* stop polling it, the session is closed below */
+				sock_destroy(seg->ftp->data);
+				seg->ftp->data = NULL;
+			}
+		}
+		if(ftp->ti.ioerror)
+			break;
+
+		if(ftp->transfer_hook) {
+			now = time(0);
+			if(now > then) {
+				ftp->transfer_hook(&ftp->ti);
+				then = now;
+			}
+		}
+	}
+	free(buf);
+	free(pfds);
+
+	for(i = 0; i < n; i++) {
+		segment_close(&segs[i]);
+		if(segs[i].done != segs[i].length)
+			r = -1;
+	}
+	ftp_set_close_handler();
+
+	return r;
+}
+
+/* gets INFILE over SEGMENTS extra sessions at once (get --segments)
+ * falls back to ftp_getfile() if the transfer can't be split
+ */
+int ftp_getfile_segmented(const char *infile, const char *outfile,
+						  getmode_t how, transfer_mode_t mode,
+						  unsigned int segments, ftp_transfer_func hookf)
+{
+	struct stat statbuf;
+	long long rp = 0, total, seglen, received = 0;
+	unsigned int i, n;
+	int fd, r;
+
+	if(segments < 2 || mode != tmBinary || how == getPipe
+	   || how == getAppend
+#ifdef HAVE_LIBSSH
+	   || ftp->session
+#endif
+		)
+		return ftp_getfile(infile, outfile, how, mode, hookf);
+
+	if(stat(outfile, &statbuf) == 0) {
+		if(S_ISDIR(statbuf.st_mode)) {
+			ftp_err(_("%s: is a directory\n"), outfile);
+			return -1;
+		}
+		if(!(statbuf.st_mode & S_IWRITE)) {
+			ftp_err(_("%s: permission denied\n"), outfile);
+			return -1;
+		}
+		if(how == getResume)
+			rp = statbuf.st_size;
+	}
+
+	total = ftp_filesize(infile);
+	if(total == -1 || rp >= total || total - rp < 2 * FTP_MIN_SEGMENT) {
+		ftp_trace("not splitting '%s' into segments\n", infile);
+		return ftp_getfile(infile, outfile, how, mode, hookf);
+	}
+
+	n = segments;
+	if((total - rp) / n < FTP_MIN_SEGMENT)
+		n = (total - rp) / FTP_MIN_SEGMENT;
+	seglen = (total - rp) / n;
+
+	fd = open(outfile, O_WRONLY | O_CREAT | (rp > 0 ? 0 : O_TRUNC), 0666);
+	if(fd == -1) {
+		ftp_err("%s: %s\n", outfile, strerror(errno));
+		return -1;
+	}
+
+	ftp->restart_offset = 0L;
+	reset_transfer_info();
+	ftp->ti.total_size = total;
+	ftp->ti.size = rp;
+	ftp->ti.restart_size = rp;
+	free(ftp->ti.remote_name);
+	free(ftp->ti.local_name);
+	ftp->ti.remote_name = xstrdup(infile);
+	ftp->ti.local_name = xstrdup(outfile);
+	ftp->transfer_hook = hookf;
+
+	segment *segs = xmalloc(n * sizeof(segment));
+	for(i = 0; i < n; i++) {
+		segs[i].offset = rp + i * seglen;
+		segs[i].length = (i == n - 1) ? total - segs[i].offset : seglen;
+	}
+	ftp_trace("getting '%s' in %u segments of %lld bytes\n",
+			  infile, n, seglen);
+
+	if(ftp->transfer_hook)
+		ftp->transfer_hook(&ftp->ti);
+	ftp->ti.begin = false;
+
+	r = recv_segments(segs, n, infile, fd);
+	if(r != 0 && !ftp->ti.interrupted && !ftp->ti.ioerror) {
+		/* resume each failed segment from where it stopped */
+		ftp_trace("retrying unfinished segments of '%s'\n", infile);
+		r = recv_segments(segs, n, infile, fd);
+	}
+
+	if(r != 0) {
+		/* keep only the contiguous part, so a later 'get --resume'
+		 * restarts at the first hole
+		 */
+		off_t valid = rp;
+		for(i = 0; i < n; i++) {
+			received += segs[i].done;
+			valid = segs[i].offset + segs[i].done;
+			if(segs[i].done != segs[i].length)
+				break;
+		}
+		for(i++; i < n; i++)
+			received += segs[i].done;
+		if(ftruncate(fd, valid) != 0)
+			ftp_err("%s: %s\n", outfile, strerror(errno));
+	}
+	close(fd);
+	free(segs);
+
+	if(r != 0 && received == 0 && !ftp->ti.interrupted && !ftp->ti.ioerror) {
+		/* no extra connections allowed, use this session only */
+		ftp_trace("segmented transfer failed, falling back to normal get\n");
+		return ftp_getfile(infile, outfile, getResume, mode, hookf);
+	}
+
+	transfer_finished();
+	return (r == 0 && !ftp->ti.interrupted && !ftp->ti.ioerror) ? 0 : -1;
+}
+
+static int putfile_once(const char *infile, const char *outfile,
+						putmode_t how, transfer_mode_t mode,
+						ftp_transfer_func hookf)
 {
 	FILE *fp;
 	int r;
@@ -1207,7 +1960,7 @@ int ftp_putfile(const char *infile, const char *outfile, putmode_t how,
 		}
 	}
 
-	foo_hookf = hookf;
+	ftp->transfer_hook = hookf;
 
 #ifdef HAVE_LIBSSH
 	if(ftp->session)
@@ -1218,3 +1971,21 @@ int ftp_putfile(const char *infile, const char *outfile, putmode_t how,
 	fclose(fp);
 	return r;
 }
+
+int ftp_putfile(const char *infile, const char *outfile, putmode_t how,
+				transfer_mode_t mode, ftp_transfer_func hookf)
+{
+	unsigned int n = 0;
+	int r = putfile_once(infile, outfile, how, mode, hookf);
+
+	while(ftp->ti.stall_abort && mode == tmBinary
+		  && (how == putNormal || how == putResume)
+		  && n++ < FTP_STALL_RETRIES && stall_reopen() == 0) {
+		/* the cached remote size is from before the transfer */
+		ftp_cache_flush_mark_for(outfile);
+		ftp_cache_flush();
+		r = putfile_once(infile, outfile, putResume, mode, hookf);
+	}
+
+	return ftp->ti.stall_abort ? -1 : r;
+}
@@ -0,0 +1,465 @@
+/*
+ * ftpwalk.c -- lists directory trees over a pool of extra sessions
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+/* The walk lists the directories of a tree breadth first, on
+ * prefetch_sessions extra sessions. Like in ftppool.c, each worker is a
+ * forked process with its own session, opened with ftp_open_clone()
+ * before the fork. The parent sends a worker one directory at a time on
+ * a pipe, and the worker sends the listing back on another pipe, in the
+ * format of the saved cache. The parent adds it to the directory cache
+ * and queues its subdirectories.
+ *
+ * The parent does this when ftp_get_directory() is called, so the
+ * recursive commands get the directories from the cache as they arrive.
+ * A directory they wait for is sent to the next free worker, before
+ * the queue.
+ */
+
+#include "syshdr.h"
+#include "ftp.h"
+#include "ftpwalk.h"
+#include "gvars.h"
+#include "xmalloc.h"
+#include "strq.h"
+
+typedef struct walk_worker
+{
+	pid_t pid;             /* 0 if the worker has quit */
+	int cmd_fd;            /* directories to list, to the worker */
+	int res_fd;            /* the listings, from the worker */
+	char *busy;            /* directory being listed, or 0 */
+	char *buf;             /* what's received of the listing */
+	size_t len, size;
+} walk_worker;
+
+typedef struct ftp_walk
+{
+	Ftp *session;          /* the session whose cache is filled */
+	walk_worker *workers;
+	unsigned int nworkers;
+	list *queue;           /* directories to list */
+	char *urgent;          /* directory to list before the queue, or 0 */
+	unsigned int listed;
+} ftp_walk;
+
+static ftp_walk *walk = 0;
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while(len > 0) {
+		const ssize_t n = write(fd, p, len);
+		if(n == -1 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	while(len > 0) {
+		const ssize_t n = read(fd, p, len);
+		if(n == -1 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* a message on the pipes is a u32 length and that many bytes; a listing
+ * is a u32 status (0 if listed) and the directory
+ */
+static int walk_send(int fd, const void *buf, uint32_t len)
+{
+	if(write_all(fd, &len, sizeof(len)) != 0)
+		return -1;
+	return write_all(fd, buf, len);
+}
+
+static void walk_worker_main(Ftp *session, int cmd_fd, int res_fd)
+{
+	ftp_use(session);
+
+	/* a reply timeout exits through exit_yafc(), which must not quit the
+	 * sessions we share with the parent
+	 */
+	gvFtpList = list_new(0);
+	list_additem(gvFtpList, session);
+	gvCurrentFtp = gvFtpList->first;
+	ftp_set_signal(SIGHUP, SIG_IGN);
+	/* the parent stops the walk when interrupted */
+	ftp_set_signal(SIGINT, SIG_IGN);
+	ftp_set_signal(SIGTERM, SIG_DFL);
+
+	uint32_t len;
+	while(read_all(cmd_fd, &len, sizeof(len)) == 0) {
+		char *path = xmalloc(len + 1);
+		if(read_all(cmd_fd, path, len) != 0) {
+			free(path);
+			break;
+		}
+
+		char *buf = 0;
+		size_t size = 0;
+		FILE *fp = open_memstream(&buf, &size);
+		if(!fp) {
+			free(path);
+			break;
+		}
+		rdirectory *rdir = ftp_read_directory(path);
+		const uint32_t status = (rdir ? 0 : 1);
+		fwrite(&status, sizeof(status), 1, fp);
+		if(rdir)
+			ftp_cache_write_directory(fp, rdir);
+		const bool failed = (fclose(fp) != 0
+							 || walk_send(res_fd, buf, size) != 0);
+		free(buf);
+		free(path);
+		/* the parent keeps the listings */
+		ftp_cache_clear();
+		if(failed || !ftp_connected())
+			break;
+	}
+
+	ftp_close_clone(session);
+	_exit(0);
+}
+
+/* tells worker W to quit, after the listing it is doing */
+static void walk_worker_quit(walk_worker *w)
+{
+	if(w->pid <= 0 || w->cmd_fd == -1)
+		return;
+
+	close(w->cmd_fd);
+	w->cmd_fd = -1;
+	/* don't wait for a listing no one wants */
+	if(w->busy)
+		kill(w->pid, SIGTERM);
+}
+
+/* stops worker W and waits for it */
+static void walk_worker_stop(walk_worker *w)
+{
+	if(w->pid <= 0)
+		return;
+
+	walk_worker_quit(w);
+	waitpid(w->pid, 0, 0);
+	close(w->res_fd);
+	w->pid = 0;
+	free(w->busy);
+	w->busy = 0;
+	free(w->buf);
+	w->buf = 0;
+	w->len = w->size = 0;
+}
+
+/* queues the subdirectories of RDIR that aren't cached; links aren't
+ * followed, as they might make loops
+ */
+static void walk_queue_subdirs(const rdirectory *rdir)
+{
+	for(listitem *li = rdir->files->first; li; li = li->next) {
+		const rfile *f = li->data;
+		if(risdir(f) && !risdotdir(f) && !ftp_cache_has_listing(f->path))
+			list_additem(walk->queue, xstrdup(f->path));
+	}
+}
+
+/* sends a directory to each idle worker */
+static void walk_dispatch(void)
+{
+	for(unsigned int i = 0; i < walk->nworkers; i++) {
+		walk_worker *w = &walk->workers[i];
+		if(w->pid <= 0 || w->busy)
+			continue;
+
+		char *path = 0;
+		while(!path) {
+			if(walk->urgent) {
+				path = walk->urgent;
+				walk->urgent = 0;
+			} else if(walk->queue->first) {
+				path = walk->queue->first->data;
+				list_delitem(walk->queue, walk->queue->first);
+			} else
+				return;
+			/* the command might have listed it already */
+			if(ftp_cache_has_listing(path)) {
+				free(path);
+				path = 0;
+			}
+		}
+
+		w->busy = path;
+		if(walk_send(w->cmd_fd, path, strlen(path)) != 0) {
+			ftp_trace("walk: worker %u has quit\n", i);
+			walk_worker_stop(w);
+		}
+	}
+}
+
+static void walk_result(walk_worker *w, const char *buf, size_t len)
+{
+	uint32_t status = 1;
+	rdirectory *rdir = 0;
+
+	if(len >= sizeof(status))
+		memcpy(&status, buf, sizeof(status));
+	if(status == 0)
+		rdir = ftp_cache_read_directory(buf + sizeof(status),
+										len - sizeof(status));
+
+	if(!rdir)
+		ftp_trace("walk: listing '%s' failed\n", w->busy);
+	else if(ftp_cache_has_listing(rdir->path))
+		/* listed meanwhile, and it might be in use */
+		rdir_destroy(rdir);
+	else {
+		walk_queue_subdirs(rdir);
+		ftp_cache_add(rdir);
+		walk->listed++;
+	}
+	free(w->busy);
+	w->busy = 0;
+}
+
+static void walk_receive(walk_worker *w)
+{
+	if(w->size - w->len < 65536) {
+		w->size = w->size * 2 + 65536;
+		w->buf = xrealloc(w->buf, w->size);
+	}
+
+	const ssize_t n = read(w->res_fd, w->buf + w->len, w->size - w->len);
+	if(n == -1 && errno == EINTR)
+		return;
+	if(n <= 0) {
+		ftp_trace("walk: worker listing '%s' has quit\n",
+				  w->busy ? w->busy : "");
+		free(w->busy);
+		w->busy = 0;
+		walk_worker_stop(w);
+		return;
+	}
+	w->len += n;
+
+	uint32_t len;
+	while(w->len >= sizeof(len)) {
+		memcpy(&len, w->buf, sizeof(len));
+		if(w->len - sizeof(len) < len)
+			break;
+		walk_result(w, w->buf + sizeof(len), len);
+		w->len -= sizeof(len) + len;
+		memmove(w->buf, w->buf + sizeof(len) + len, w->len);
+	}
+}
+
+/* hands out directories to idle workers, and receives the listings,
+ * waiting up to TIMEOUT milliseconds for one
+ * returns false if there is nothing left to list
+ */
+static bool walk_pump(int timeout)
+{
+	walk_dispatch();
+
+	struct pollfd *fds = xmalloc(walk->nworkers * sizeof(struct pollfd));
+	unsigned int *which = xmalloc(walk->nworkers * sizeof(unsigned int));
+	unsigned int i, n = 0;
+
+	for(i = 0; i < walk->nworkers; i++) {
+		if(walk->workers[i].pid > 0 && walk->workers[i].busy) {
+			fds[n].fd = walk->workers[i].res_fd;
+			fds[n].events = POLLIN;
+			which[n++] = i;
+		}
+	}
+
+	if(n > 0 && poll(fds, n, timeout) > 0) {
+		for(i = 0; i < n; i++) {
+			if(fds[i].revents)
+				walk_receive(&walk->workers[which[i]]);
+		}
+	}
+	free(fds);
+	free(which);
+
+	return n > 0;
+}
+
+static bool walk_is_busy(const char *path)
+{
+	if(walk->urgent && strcmp(walk->urgent, path) == 0)
+		return true;
+	for(unsigned int i = 0; i < walk->nworkers; i++) {
+		const walk_worker *w = &walk->workers[i];
+		if(w->pid > 0 && w->busy && strcmp(w->busy, path) == 0)
+			return true;
+	}
+	return false;
+}
+
+rdirectory *ftp_walk_wait(const char *path)
+{
+	if(!walk || ftp != walk->session)
+		return 0;
+
+	char *dir = ftp_path_absolute(path);
+	stripslash(dir);
+
+	if(ftp_cache_has_listing(dir)) {
+		/* keep the workers going */
+		walk_pump(0);
+		free(dir);
+		return 0;
+	}
+
+	if(!walk_is_busy(dir)) {
+		listitem *li = list_search(walk->queue, (listsearchfunc)strcmp, dir);
+		if(!li) {
+			walk_pump(0);
+			free(dir);
+			return 0;
+		}
+		free(walk->urgent);
+		walk->urgent = li->data;
+		list_delitem(walk->queue, li);
+	}
+
+	ftp_trace("walk: waiting for '%s'\n", dir);
+	ftp_set_close_handler();
+	while(!gvInterrupted && walk_is_busy(dir) && walk_pump(ALARM_USEC / 1000))
+		/* wait */ ;
+
+	rdirectory *rdir = ftp_cache_get_directory(dir);
+	free(dir);
+	return rdir;
+}
+
+void ftp_walk_begin(const list *gl)
+{
+	ftp_walk_end();
+
+	if(gvPrefetchSessions == 0 || !ftp_loggedin())
+		return;
+#ifdef HAVE_LIBSSH
+	if(ftp->session)
+		return;
+#endif
+
+	walk = xmalloc(sizeof(ftp_walk));
+	walk->session = ftp;
+	walk->queue = list_new(0);
+
+	for(listitem *li = gl->first; li; li = li->next) {
+		const rfile *f = li->data;
+		if(!(risdir(f) || rislink(f)) || risdotdir(f))
+			continue;
+		rdirectory *rdir = ftp_cache_get_directory(f->path);
+		if(rdir)
+			walk_queue_subdirs(rdir);
+		else
+			list_additem(walk->queue, xstrdup(f->path));
+	}
+	if(list_numitem(walk->queue) == 0) {
+		ftp_walk_end();
+		return;
+	}
+
+	walk->workers = xmalloc(gvPrefetchSessions * sizeof(walk_worker));
+	fflush(stdout);
+	fflush(stderr);
+	for(unsigned int i = 0; i < gvPrefetchSessions && !gvInterrupted; i++) {
+		int cmd[2], res[2];
+		Ftp *session = ftp_open_clone();
+		if(!session)
+			break;
+		if(pipe(cmd) == -1) {
+			ftp_close_clone(session);
+			break;
+		}
+		if(pipe(res) == -1) {
+			close(cmd[0]);
+			close(cmd[1]);
+			ftp_close_clone(session);
+			break;
+		}
+
+		const pid_t pid = fork();
+		if(pid == 0) {
+			/* so the other workers see the end of their pipes */
+			for(unsigned int j = 0; j < walk->nworkers; j++) {
+				close(walk->workers[j].cmd_fd);
+				close(walk->workers[j].res_fd);
+			}
+			close(cmd[1]);
+			close(res[0]);
+			walk_worker_main(session, cmd[0], res[1]);
+		}
+		close(cmd[0]);
+		close(res[1]);
+		if(pid == -1) {
+			perror("fork()");
+			close(cmd[1]);
+			close(res[0]);
+			ftp_close_clone(session);
+			break;
+		}
+		/* the worker has its own copy, don't QUIT it */
+		ftp_destroy(session);
+
+		walk_worker *w = &walk->workers[walk->nworkers++];
+		w->pid = pid;
+		w->cmd_fd = cmd[1];
+		w->res_fd = res[0];
+	}
+
+	if(walk->nworkers < gvPrefetchSessions)
+		ftp_trace("walk: only %u of %u sessions opened\n", walk->nworkers,
+				  gvPrefetchSessions);
+	if(walk->nworkers == 0) {
+		ftp_walk_end();
+		return;
+	}
+
+	walk_dispatch();
+}
+
+void ftp_walk_end(void)
+{
+	if(!walk)
+		return;
+
+	/* they all QUIT at once */
+	for(unsigned int i = 0; i < walk->nworkers; i++)
+		walk_worker_quit(&walk->workers[i]);
+	for(unsigned int i = 0; i < walk->nworkers; i++)
+		walk_worker_stop(&walk->workers[i]);
+	if(walk->nworkers)
+		ftp_trace("walk: listed %u directories\n", walk->listed);
+
+	for(listitem *li = walk->queue->first; li; li = li->next)
+		free(li->data);
+	list_free(walk->queue);
+	free(walk->urgent);
+	free(walk->workers);
+	free(walk);
+	walk = 0;
+}
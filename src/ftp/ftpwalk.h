@@ -0,0 +1,30 @@
+/*
+ * ftpwalk.h -- lists directory trees over a pool of extra sessions
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+#ifndef _ftpwalk_h_included
+#define _ftpwalk_h_included
+
+#include "ftp.h"
+
+/* starts listing the trees under the directories in GL (a list of
+ * rfiles) in the background, if prefetch_sessions is set
+ */
+void ftp_walk_begin(const list *gl);
+
+/* waits for the directory PATH if it is still to be listed by the walk
+ * returns the cached directory, or 0 if the walk doesn't list it
+ */
+rdirectory *ftp_walk_wait(const char *path);
+
+/* stops the walk, if any */
+void ftp_walk_end(void);
+
+#endif
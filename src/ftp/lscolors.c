@@ -17,10 +17,18 @@
 #include "strq.h"
 #include "lscolors.h"
 
-typedef struct {
+/* LS_COLORS masks are matched in the order given, the first match wins;
+ * masks like "*.ext" are looked up by suffix in a hash table, the other
+ * ones are kept in a list and matched with fnmatch()
+ */
+typedef struct lscolor lscolor;
+struct lscolor {
   char *msk;
-  char *clr;
-} lscolor;
+  char *esc;            /* escape code, lc + color + rc */
+  unsigned int order;   /* position in LS_COLORS */
+  unsigned int hash;    /* of the suffix, for extensions */
+  lscolor *next;        /* in the same bucket */
+};
 
 static bool colors_initialized = false;
 static int number_of_colors = 0;
@@ -30,8 +38,80 @@ static char *diclr = NULL, *lnclr = NULL, *ficlr = NULL, *exclr = NULL;
 static char *bdclr = NULL, *cdclr = NULL, *piclr = NULL, *soclr = NULL;
 static char *lc = NULL, *rc = NULL, *ec = NULL;
 
+/* and their escape codes */
+static char *diesc = NULL, *lnesc = NULL, *fiesc = NULL, *exesc = NULL;
+static char *bdesc = NULL, *cdesc = NULL, *piesc = NULL, *soesc = NULL;
+
 static lscolor *clrs = NULL;
 
+#define EXT_BUCKETS 64
+static lscolor *extensions[EXT_BUCKETS];
+static lscolor **globs = NULL;
+static unsigned int number_of_globs = 0;
+
+/* FNV-1a */
+static unsigned int suffix_hash(const char *s)
+{
+  unsigned int h = 2166136261u;
+  for (; *s; s++)
+  {
+    h ^= (unsigned char)*s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static char *make_escape(const char *clr)
+{
+  if (!clr)
+    clr = "";
+  const size_t len = strlen(lc) + strlen(clr) + strlen(rc) + 1;
+  char* esc = xmalloc(len);
+  snprintf(esc, len, "%s%s%s", lc, clr, rc);
+  return esc;
+}
+
+/* sorts the masks into extensions and globs */
+static void compile_colors(void)
+{
+  globs = xmalloc((number_of_colors + 1) * sizeof(lscolor *));
+
+  for (int i = 0; i < number_of_colors; i++)
+  {
+    lscolor* c = &clrs[i];
+    c->order = i;
+    if (c->msk[0] == '*' && c->msk[1] && !strpbrk(c->msk + 1, "*?[\\"))
+    {
+      c->hash = suffix_hash(c->msk + 1);
+      c->next = extensions[c->hash % EXT_BUCKETS];
+      extensions[c->hash % EXT_BUCKETS] = c;
+    }
+    else
+      globs[number_of_globs++] = c;
+  }
+}
+
+/* returns the first extension mask matching NAME, or 0 */
+static const lscolor *match_extension(const char *name)
+{
+  const lscolor* best = NULL;
+
+  /* "*.gz" matches any name ending in ".gz", so try every suffix that
+   * some mask could end with
+   */
+  for (const char* s = name; *s; s++)
+  {
+    const unsigned int h = suffix_hash(s);
+    for (const lscolor* c = extensions[h % EXT_BUCKETS]; c; c = c->next)
+    {
+      if (c->hash == h && strcmp(c->msk + 1, s) == 0
+          && (!best || c->order < best->order))
+        best = c;
+    }
+  }
+  return best;
+}
+
 char *endcolor(void)
 {
   return ec;
@@ -82,10 +162,10 @@ void init_colors(void)
         rc = clr;
       else if(strcmp(msk, "ec") == 0) /* end code (lc+fi+rc) */
         ec = clr;
-      else
+      else if (clr) /* masks without a color are ignored */
       {
         clrs[i].msk = xstrdup(msk);
-        clrs[i].clr = clr;
+        clrs[i].esc = clr;
         i++;
       }
     }
@@ -121,6 +201,23 @@ void init_colors(void)
   if (!ec)
     ec = xstrdup("\x1B[0m");
 
+  /* the escape codes are built once, and shared by all files */
+  for (i = 0; i < number_of_colors; i++)
+  {
+    char* clr = clrs[i].esc;
+    clrs[i].esc = make_escape(clr);
+    free(clr);
+  }
+  diesc = make_escape(diclr);
+  lnesc = make_escape(lnclr);
+  fiesc = make_escape(ficlr);
+  exesc = make_escape(exclr);
+  bdesc = make_escape(bdclr);
+  cdesc = make_escape(cdclr);
+  piesc = make_escape(piclr);
+  soesc = make_escape(soclr);
+  compile_colors();
+
   colors_initialized = true;
 }
 
@@ -132,9 +229,20 @@ void free_colors(void)
   for (unsigned int i = 0; i != number_of_colors; ++i)
   {
     free(clrs[i].msk);
-    free(clrs[i].clr);
+    free(clrs[i].esc);
   }
   free(clrs);
+  free(globs);
+  memset(extensions, 0, sizeof(extensions));
+  number_of_globs = 0;
+  free(diesc);
+  free(lnesc);
+  free(fiesc);
+  free(exesc);
+  free(bdesc);
+  free(cdesc);
+  free(piesc);
+  free(soesc);
   free(diclr);
   free(lnclr);
   free(ficlr);
@@ -148,46 +256,52 @@ void free_colors(void)
   free(ec);
 
   clrs = NULL;
+  globs = NULL;
+  diesc = lnesc = fiesc = exesc = bdesc = cdesc = piesc = soesc = NULL;
   diclr = lnclr = ficlr = exclr = bdclr = cdclr = piclr = soclr = lc =
     rc = ec = NULL;
   colors_initialized = false;
 }
 
-void rfile_parse_colors(rfile *f)
+/* returns the escape code to show F in, shared by all files with
+ * the same color
+ */
+const char *rfile_color(const rfile *f)
 {
-  char *e, *q;
-  int i;
-
   /* colors should already been initialized by init_colors */
 
-  e = 0;
   if(risdir(f))
-    e = diclr;
-  else if(rislink(f))
-    e = lnclr;
-  else if(rischardev(f))
-    e = cdclr;
-  else if(risblockdev(f))
-    e = bdclr;
-  else if(rispipe(f))
-    e = piclr;
-  else if(rissock(f))
-    e = soclr;
+    return diesc;
+  if(rislink(f))
+    return lnesc;
+  if(rischardev(f))
+    return cdesc;
+  if(risblockdev(f))
+    return bdesc;
+  if(rispipe(f))
+    return piesc;
+  if(rissock(f))
+    return soesc;
 
   /* do this before checking for executable, because
    * on [v]fat filesystems, all files are 'executable'
    */
-  for(i=0;i<number_of_colors && !e;i++) {
-    if(fnmatch(clrs[i].msk, base_name_ptr(f->path), 0) == 0)
-      e = clrs[i].clr;
+  const char* name = base_name_ptr(f->path);
+  const lscolor* c = match_extension(name);
+  for(unsigned int i = 0;
+      i < number_of_globs && (!c || globs[i]->order < c->order); i++) {
+    if(fnmatch(globs[i]->msk, name, 0) == 0) {
+      c = globs[i];
+      break;
+    }
   }
+  if(c)
+    return c->esc;
 
   /* a file is considered executable if there is
    * an 'x' anywhere in its permission string */
-  if(!e && risexec(f))
-    e = exclr;
+  if(risexec(f))
+    return exesc;
 
-  q = e ? e : ficlr;
-  f->color = (char *)xmalloc(strlen(lc) + strlen(q) + strlen(rc) + 1);
-  sprintf(f->color, "%s%s%s", lc, q, rc);
+  return fiesc;
 }
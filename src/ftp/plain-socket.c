@@ -21,6 +21,7 @@ struct socket_impl_
 {
   int handle;
   FILE *sin, *sout;
+  int pipefd[2];  /* for ps_recvfile, -1 until used */
 };
 
 static bool create_streams(socket_impl* sock, const char* inmode,
@@ -79,6 +80,11 @@ static void ps_destroy(Socket* sockp)
   destroy_streams(sockp->data);
   if (sockp->data->handle != -1)
     close(sockp->data->handle);
+  if (sockp->data->pipefd[0] != -1)
+  {
+    close(sockp->data->pipefd[0]);
+    close(sockp->data->pipefd[1]);
+  }
   free(sockp->data);
   free(sockp);
 }
@@ -238,6 +244,41 @@ static void ps_throughput(Socket *sockp)
 #endif
 }
 
+static int ps_set_bufsize(Socket *sockp, int size)
+{
+#ifdef HAVE_SETSOCKOPT
+  int r = -1;
+  socklen_t len = sizeof(r);
+  /* never shrink what the kernel already chose */
+  if (getsockopt(sockp->data->handle, SOL_SOCKET, SO_RCVBUF, &r, &len) == 0
+      && r >= size)
+    return r;
+  len = sizeof(r);
+  if (setsockopt(sockp->data->handle, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1
+      || setsockopt(sockp->data->handle, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == -1)
+    return -1;
+  /* the kernel may have adjusted it */
+  if (getsockopt(sockp->data->handle, SOL_SOCKET, SO_RCVBUF, &r, &len) == -1)
+    return -1;
+  return r;
+#else
+  return -1;
+#endif
+}
+
+static long ps_rtt(Socket *sockp)
+{
+#if defined(TCP_INFO) && defined(HAVE_NETINET_TCP_H)
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (getsockopt(sockp->data->handle, IPPROTO_TCP, TCP_INFO, &info, &len) == -1)
+    return -1;
+  return info.tcpi_rtt;
+#else
+  return -1;
+#endif
+}
+
 static void ps_lowdelay(Socket *sockp)
 {
 #if defined(IPTOS_LOWDELAY) && defined(HAVE_SETSOCKOPT)
@@ -266,6 +307,69 @@ static ssize_t ps_write(Socket *sockp, const void* buf, size_t num)
 #endif
 }
 
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+static ssize_t ps_sendfile(Socket *sockp, int fd, off_t *offset, size_t num)
+{
+#ifdef SECFTP
+  /* protected data has to go through sec_write */
+  if (ftp->sec_complete && ftp->data_prot != prot_clear)
+  {
+    errno = ENOSYS;
+    return -1;
+  }
+#endif
+  return sendfile(sockp->data->handle, fd, offset, num);
+}
+#endif
+
+#ifdef HAVE_SPLICE
+/* splices from the socket into a pipe, and from the pipe into FD */
+static ssize_t ps_recvfile(Socket *sockp, int fd, size_t num)
+{
+  socket_impl* data = sockp->data;
+
+#ifdef SECFTP
+  /* protected data has to go through sec_read */
+  if (ftp->sec_complete && ftp->data_prot != prot_clear)
+  {
+    errno = ENOSYS;
+    return -1;
+  }
+#endif
+
+  if (data->pipefd[0] == -1 && pipe(data->pipefd) == -1)
+  {
+    data->pipefd[0] = data->pipefd[1] = -1;
+    errno = ENOSYS;
+    return -1;
+  }
+
+  const ssize_t n = splice(data->handle, NULL, data->pipefd[1], NULL, num,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+  if (n <= 0)
+    return n;
+
+  /* the pipe must be drained, or the bytes in it are lost */
+  ssize_t left = n;
+  while (left > 0)
+  {
+    const ssize_t w = splice(data->pipefd[0], NULL, fd, NULL, left,
+                             SPLICE_F_MOVE);
+    if (w == -1 && errno == EINTR)
+      continue;
+    if (w <= 0)
+    {
+      /* not a refusal anymore, those bytes are gone */
+      if (w == 0 || errno == EINVAL || errno == ENOSYS)
+        errno = EIO;
+      return -1;
+    }
+    left -= w;
+  }
+  return n;
+}
+#endif
+
 static int ps_get(Socket *sockp)
 {
 #ifdef SECFTP
@@ -328,20 +432,35 @@ static int ps_error(Socket* sockp, bool inout)
 
 static int ps_check_pending(Socket* sockp, bool inout)
 {
-  struct timeval tv;
-  fd_set fds;
-
-  	/* watch fd to see if it has input */
-	FD_ZERO(&fds);
-  FD_SET(sockp->data->handle, &fds);
-	/* wait max 0.5 second */
-	tv.tv_sec = 0;
-	tv.tv_usec = 500000;
-
-	if (!inout) /* wait for read */
-		return select(sockp->data->handle + 1, &fds, NULL, NULL, &tv);
-	else /* wait for write */
-		return select(sockp->data->handle + 1, NULL, &fds, NULL, &tv);
+  struct pollfd pfd;
+
+  pfd.fd = sockp->data->handle;
+  pfd.events = inout ? POLLOUT : POLLIN; /* wait for write or read */
+  pfd.revents = 0;
+
+  /* wait max 0.5 second, or until a signal arrives */
+  const int r = poll(&pfd, 1, 500);
+  return r > 0 ? 1 : r;
+}
+
+static bool ps_set_nonblocking(Socket* sockp, bool on)
+{
+#ifdef SECFTP
+  /* sec_read and sec_write need whole protected blocks */
+  if (on && ftp->sec_complete && ftp->data_prot != prot_clear)
+    return false;
+#endif
+
+  const int fl = fcntl(sockp->data->handle, F_GETFL);
+  if (fl == -1)
+    return false;
+  return fcntl(sockp->data->handle, F_SETFL,
+               on ? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK)) != -1;
+}
+
+static int ps_handle(Socket* sockp)
+{
+  return sockp->data->handle;
 }
 
 static int ps_eof(Socket* sockp)
@@ -357,6 +476,7 @@ Socket* sock_create(void)
   sock->data = xmalloc(sizeof(socket_impl));
   memset(sock->data, 0, sizeof(socket_impl));
   sock->data->handle = -1;
+  sock->data->pipefd[0] = sock->data->pipefd[1] = -1;
 
   sock->destroy = ps_destroy;
   sock->connect_addr = ps_connect_addr;
@@ -367,6 +487,12 @@ Socket* sock_create(void)
   sock->lowdelay = ps_lowdelay;
   sock->read = ps_read;
   sock->write = ps_write;
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+  sock->sendfile = ps_sendfile;
+#endif
+#ifdef HAVE_SPLICE
+  sock->recvfile = ps_recvfile;
+#endif
   sock->get = ps_get;
   sock->put = ps_put;
   sock->vprintf = ps_vprintf;
@@ -375,6 +501,10 @@ Socket* sock_create(void)
   sock->eof = ps_eof;
   sock->telnet_interrupt = ps_telnet_interrupt;
   sock->check_pending = ps_check_pending;
+  sock->set_nonblocking = ps_set_nonblocking;
+  sock->set_bufsize = ps_set_bufsize;
+  sock->rtt = ps_rtt;
+  sock->handle = ps_handle;
   sock->clear_error = ps_clearerr;
   sock->error = ps_error;
 
@@ -17,8 +17,11 @@
 rdirectory *rdir_create(void)
 {
   rdirectory* rdir = xmalloc(sizeof(rdirectory));
-  rdir->files = list_new((listfunc)rfile_destroy);
+  /* the rfiles are freed with the arena */
+  rdir->files = list_new(0);
+  rdir->mem = arena_new();
   rdir->timestamp = time(0);
+  rdir->mtime = (time_t)-1;
 
   return rdir;
 }
@@ -29,66 +32,297 @@ void rdir_destroy(rdirectory *rdir)
     return;
 
   list_free(rdir->files);
+  arena_free(rdir->mem);
+  free(rdir->index);
   free(rdir->path);
+  free(rdir->filter);
   free(rdir);
 }
 
+/* returns the memory used by RDIR */
+size_t rdir_memory(const rdirectory *rdir)
+{
+  return sizeof(rdirectory) + sizeof(list)
+    + list_numitem(rdir->files) * sizeof(listitem)
+    + arena_size(rdir->mem)
+    + rdir->nindex * sizeof(rfile *)
+    + (rdir->path ? strlen(rdir->path) + 1 : 0);
+}
+
 unsigned long int rdir_size(rdirectory *rdir)
 {
   return rglob_size(rdir->files);
 }
 
+struct rdir_parser
+{
+  rdirectory* rdir;
+  char* path;
+  bool is_mlsd;
+  rfile* f;
+  char* line;        /* the line being received */
+  size_t len, size;
+  bool failed;
+  bool done;         /* an empty line ends the listing */
+  bool more;         /* something followed the empty line */
+};
+
+rdir_parser *rdir_parse_begin(rdirectory *rdir, const char *path, bool is_mlsd)
+{
+  free(rdir->path);
+  rdir->path = NULL;
+  free(rdir->index);
+  rdir->index = NULL;
+  rdir->nindex = 0;
+  list_clear(rdir->files);
+  arena_free(rdir->mem);
+  rdir->mem = arena_new();
+  rdir->timestamp = time(0);
+
+  rdir_parser* p = xmalloc(sizeof(rdir_parser));
+  p->rdir = rdir;
+  p->path = xstrdup(path);
+  p->is_mlsd = is_mlsd;
+  p->f = rfile_create();
+
+  ftp_trace("*** start parsing directory listing of '%s' ***\n", path);
+  rfile_parse_begin();
+  return p;
+}
+
+/* returns true if the MLSD line is the type=cdir entry, for the listed
+ * directory itself
+ */
+static bool is_cdir_line(const char *line)
+{
+  /* the facts end at the first space */
+  const char* end = strchr(line, ' ');
+  const char* s = line;
+  while (end && s < end)
+  {
+    const char* e = memchr(s, ';', end - s);
+    if (!e)
+      e = end;
+    if (e - s == 9 && strncasecmp(s, "type=cdir", 9) == 0)
+      return true;
+    s = e + 1;
+  }
+  return false;
+}
+
+static void parse_line(rdir_parser *p)
+{
+  p->line[p->len] = 0;
+  p->len = 0;
+  strip_trailing_chars(p->line, "\r\n");
+  if (!p->line[0])
+  {
+    p->done = true;
+    return;
+  }
+  ftp_trace("%s\n", p->line);
+
+  rfile_clear(p->f);
+  const bool cdir = p->is_mlsd && is_cdir_line(p->line);
+  const int r = rfile_parse(p->f, p->line, p->path, p->is_mlsd);
+  if (r == -1)
+  {
+    ftp_err("parsing failed on '%s'\n", p->line);
+    list_clear(p->rdir->files);
+    p->failed = true;
+  }
+  else if (r == 0)
+  {
+    /* the modification time of the directory, for nothing */
+    if (cdir && p->f->mtime > 0)
+      p->rdir->mtime = p->f->mtime;
+    rdir_add_file(p->rdir, p->f);
+  }
+  /* else r == 1, ie a 'total ###' line, which isn't an error */
+}
+
+/* appends N bytes to the current line */
+static void line_append(rdir_parser *p, const char *buf, size_t n)
+{
+  if (p->len + n + 1 > p->size)
+  {
+    p->size = p->len + n + 1 < 512 ? 512 : (p->len + n + 1) * 2;
+    p->line = xrealloc(p->line, p->size);
+  }
+  memcpy(p->line + p->len, buf, n);
+  p->len += n;
+}
+
+/* parses the next LEN bytes of the listing, lines can be split anywhere */
+void rdir_parse_data(rdir_parser *p, const char *buf, size_t len)
+{
+  while (len > 0 && !p->done)
+  {
+    const char* e = memchr(buf, '\n', len);
+    if (!e)
+    {
+      line_append(p, buf, len);
+      return;
+    }
+    line_append(p, buf, e - buf);
+    parse_line(p);
+    len -= e + 1 - buf;
+    buf = e + 1;
+  }
+
+  for (; p->done && !p->more && len > 0; buf++, len--)
+  {
+    if (!isspace((unsigned char)*buf))
+      p->more = true;
+  }
+}
+
+/* returns true if a line couldn't be parsed so far */
+bool rdir_parse_failed(const rdir_parser *p)
+{
+  return p->failed;
+}
+
+/* returns true if the listing went on after an empty line, which was
+ * ignored
+ */
+bool rdir_parse_truncated(const rdir_parser *p)
+{
+  return p->more;
+}
+
+/* parses what's left of the listing and frees P
+ * returns 0 on success, else -1
+ */
+int rdir_parse_end(rdir_parser *p)
+{
+  int r = 0;
+
+  if (p->len > 0 && !p->done)
+    parse_line(p);
+  rfile_destroy(p->f);
+  rfile_parse_end();
+  ftp_trace("*** end parsing directory listing ***\n");
+
+  if (p->failed && list_numitem(p->rdir->files) == 0)
+  {
+    ftp_err("directory parsing failed completely\n");
+    r = -1;
+  }
+  else
+    p->rdir->path = xstrdup(p->path);
+
+  free(p->line);
+  free(p->path);
+  free(p);
+  return r;
+}
+
 int rdir_parse(rdirectory *rdir, FILE *fp, const char *path, bool is_mlsd)
 {
-	int r;
-	bool failed = false;
-
-	free(rdir->path);
-	rdir->path = NULL;
-	list_clear(rdir->files);
-	rdir->timestamp = time(0);
-
-	rfile* f = rfile_create();
-
-	ftp_trace("*** start parsing directory listing of '%s' ***\n", path);
-
-	while(!feof(fp)) {
-		char tmp[512];
-		if(fgets(tmp, sizeof(tmp), fp) == 0)
-			break;
-		strip_trailing_chars(tmp, "\r\n");
-		if(!tmp[0])
-			break;
-		ftp_trace("%s\n", tmp);
-
-		rfile_clear(f);
-		r = rfile_parse(f, tmp, path, is_mlsd);
-		if(r == -1) {
-			ftp_err("parsing failed on '%s'\n", tmp);
-			list_clear(rdir->files);
-			failed = true;
-		} else if(r == 0)
-			list_additem(rdir->files, rfile_clone(f));
-		/* else r == 1, ie a 'total ###' line, which isn't an error */
-	}
-  rfile_destroy(f);
-	ftp_trace("*** end parsing directory listing ***\n");
-	if(failed) {
-		if(list_numitem(rdir->files) == 0) {
-			ftp_err("directory parsing failed completely\n");
-			return -1;
-		}
-	}
-	rdir->path = xstrdup(path);
-	return 0;
+  char buf[4096];
+  size_t n;
+
+  rdir_parser* p = rdir_parse_begin(rdir, path, is_mlsd);
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    rdir_parse_data(p, buf, n);
+  return rdir_parse_end(p);
+}
+
+/* returns the session's copy of S, which lives until the session is
+ * destroyed; there are only a handful of different ones, so all the
+ * cached directories share them
+ */
+static char *intern_string(const char *s)
+{
+  if (!ftp->strings)
+    ftp->strings = arena_new();
+  return (char *)arena_intern(ftp->strings, s);
+}
+
+/* adds a copy of F to RDIR, in the directory's arena
+ * the permissions, owner and group are interned
+ */
+void rdir_add_file(rdirectory *rdir, const rfile *f)
+{
+  rfile* nf = arena_alloc(rdir->mem, sizeof(rfile));
+  nf->perm = intern_string(f->perm);
+  nf->owner = intern_string(f->owner);
+  nf->group = intern_string(f->group);
+  nf->date = arena_strdup(rdir->mem, f->date);
+  nf->link = arena_strdup(rdir->mem, f->link);
+  nf->path = arena_strdup(rdir->mem, f->path);
+  nf->size = f->size;
+  nf->nhl = f->nhl;
+  nf->mtime = f->mtime;
+
+  list_additem(rdir->files, nf);
+}
+
+typedef struct index_entry
+{
+  rfile* file;
+  const char* name;
+  size_t pos;        /* position in rdir->files */
+} index_entry;
+
+static int compare_index(const void* A, const void* B)
+{
+  const index_entry* a = A;
+  const index_entry* b = B;
+
+  const int c = strcmp(a->name, b->name);
+  if (c)
+    return c;
+  /* keep duplicates in list order, the first one is found */
+  return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+/* (re)builds the index of files sorted by name
+ */
+static void rdir_index(rdirectory* rdir)
+{
+  free(rdir->index);
+  rdir->index = NULL;
+  rdir->nindex = list_numitem(rdir->files);
+  if (rdir->nindex == 0)
+    return;
+
+  index_entry* e = xmalloc(rdir->nindex * sizeof(index_entry));
+  size_t i = 0;
+  for (listitem* li = rdir->files->first; li; li = li->next, i++)
+  {
+    e[i].file = li->data;
+    e[i].name = base_name_ptr(e[i].file->path);
+    e[i].pos = i;
+  }
+  qsort(e, rdir->nindex, sizeof(index_entry), compare_index);
+
+  rdir->index = xmalloc(rdir->nindex * sizeof(rfile *));
+  for (i = 0; i < rdir->nindex; i++)
+    rdir->index[i] = e[i].file;
+  free(e);
 }
 
 rfile *rdir_get_file(rdirectory *rdir, const char *filename)
 {
-  listitem* li = list_search(rdir->files, (listsearchfunc)rfile_search_filename,
-      filename);
-  if (li)
-    return (rfile*)li->data;
+  if (rdir->nindex != list_numitem(rdir->files))
+    rdir_index(rdir);
+
+  /* find the first file not sorted before FILENAME */
+  size_t lo = 0, hi = rdir->nindex;
+  while (lo < hi)
+  {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(base_name_ptr(rdir->index[mid]->path), filename) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < rdir->nindex
+      && strcmp(base_name_ptr(rdir->index[lo]->path), filename) == 0)
+    return rdir->index[lo];
   return NULL;
 }
 
@@ -109,4 +343,5 @@ void rdir_sort(rdirectory* dir)
     return;
 
   list_sort(dir->files, compare_files, false);
+  rdir_index(dir);
 }
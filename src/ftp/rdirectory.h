@@ -16,19 +16,37 @@
 #include "syshdr.h"
 #include "rfile.h"
 #include "linklist.h"
+#include "arena.h"
 
 typedef struct rdirectory
 {
   char *path;        /* directory path */
-  list *files;       /* linked list of rfiles */
+  list *files;       /* linked list of rfiles, allocated in mem */
+  arena *mem;
+  rfile **index;     /* the files sorted by name, for rdir_get_file() */
+  size_t nindex;
   time_t timestamp;  /* time of creation */
+  time_t mtime;      /* modification time of the directory, or -1 */
+  bool sparse;       /* only files looked up one by one, not a listing */
+  bool loaded;       /* from the saved cache, and not checked since */
+  char *filter;      /* mask the server matched the files with, or 0 */
 } rdirectory;
 
+/* parses a listing as it is received */
+typedef struct rdir_parser rdir_parser;
+
 rdirectory* rdir_create(void);
 void rdir_destroy(rdirectory *rdir);
 int rdir_parse(rdirectory *rdir, FILE *fp, const char *path, bool is_mlsd);
+rdir_parser *rdir_parse_begin(rdirectory *rdir, const char *path, bool is_mlsd);
+void rdir_parse_data(rdir_parser *p, const char *buf, size_t len);
+bool rdir_parse_failed(const rdir_parser *p);
+bool rdir_parse_truncated(const rdir_parser *p);
+int rdir_parse_end(rdir_parser *p);
 rfile* rdir_get_file(rdirectory *rdir, const char *filename);
+void rdir_add_file(rdirectory *rdir, const rfile *f);
 unsigned long int rdir_size(rdirectory* rdir);
+size_t rdir_memory(const rdirectory *rdir);
 void rdir_sort(rdirectory* rdir);
 
 #endif
@@ -25,7 +25,6 @@ rfile *rfile_clone(const rfile *f)
   nf->perm = xstrdup(f->perm);
   nf->owner = xstrdup(f->owner);
   nf->group = xstrdup(f->group);
-  nf->color = xstrdup(f->color);
   nf->date = xstrdup(f->date);
   nf->link = xstrdup(f->link);
   nf->path = xstrdup(f->path);
@@ -41,11 +40,10 @@ void rfile_clear(rfile *f)
   free(f->perm);
   free(f->owner);
   free(f->group);
-  free(f->color);
   free(f->date);
   free(f->link);
   free(f->path);
-  f->perm = f->owner = f->group = f->color = NULL;
+  f->perm = f->owner = f->group = NULL;
   f->date = f->link = f->path = NULL;
   f->nhl = 0;
   f->size = 0L;
@@ -126,7 +124,6 @@ void rfile_fake(rfile *f, const char *path)
     f->mtime = 0;
     f->nhl = 0;
     f->size = (unsigned long long)-1;
-    rfile_parse_colors(f);
 }
 
 char rfile_classchar(const rfile *f)
@@ -185,20 +182,175 @@ static const char *month_name[] = {
  */
 int month_number(const char *str)
 {
-    int i;
+    /* (2nd + 3rd letter, lower case) % 17 is different for each month */
+    static const signed char months[17] = {
+        -1, -1, -1, 0, 6, 3, 5, 2, 10, 8, -1, 9, 1, 11, 4, -1, 7
+    };
 
-    for(i=0; i<12; i++) {
-        if(strcasecmp(str, month_name[i]) == 0)
-            return i;
-    }
+    if(!str[0] || !str[1] || !str[2] || str[3])
+        return -1;
+
+    const int i = months[(tolower((unsigned char)str[1])
+                          + tolower((unsigned char)str[2])) % 17];
+    if(i != -1 && strcasecmp(str, month_name[i]) == 0)
+        return i;
 
     return -1;
 }
 
+/* Parsing a listing needs the current time and the UTC offset of many
+ * dates, which is slow to get from localtime() and mktime() for each line.
+ * Between rfile_parse_begin() and rfile_parse_end() the current time is
+ * kept, and so is the UTC offset of each day seen, as long as it is the
+ * same all day (else mktime() is used).
+ */
+
+typedef struct day_offset {
+    bool valid;
+    bool constant;  /* same offset all day */
+    long day;       /* days since the epoch */
+    int isdst;      /* tm_isdst it was asked for */
+    long offset;    /* local time - UTC, in seconds */
+} day_offset;
+
+#define DAY_OFFSETS 128
+
+static struct {
+    bool listing;
+    time_t now;
+    struct tm tm_now;
+    day_offset offsets[DAY_OFFSETS];
+} parse_time;
+
+void rfile_parse_begin(void)
+{
+    memset(&parse_time, 0, sizeof(parse_time));
+    time(&parse_time.now);
+    parse_time.tm_now = *localtime(&parse_time.now);
+    parse_time.listing = true;
+}
+
+void rfile_parse_end(void)
+{
+    parse_time.listing = false;
+}
+
+static time_t parse_now(struct tm *tm_now)
+{
+    if(!parse_time.listing) {
+        time(&parse_time.now);
+        parse_time.tm_now = *localtime(&parse_time.now);
+    }
+    if(tm_now)
+        *tm_now = parse_time.tm_now;
+    return parse_time.now;
+}
+
+/* days since 1970-01-01 of year Y, month M (1-12), day D */
+static long days_from_civil(long y, long m, long d)
+{
+    y -= m <= 2;
+    const long era = (y >= 0 ? y : y - 399) / 400;
+    const long yoe = y - era * 400;
+    const long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* the broken down date of DAY days since 1970-01-01, at noon */
+static void civil_from_days(long day, struct tm *t)
+{
+    day += 719468;
+    const long era = (day >= 0 ? day : day - 146096) / 146097;
+    const long doe = day - era * 146097;
+    const long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const long mp = (5 * doy + 2) / 153;
+    const long m = mp + (mp < 10 ? 3 : -9);
+
+    memset(t, 0, sizeof(*t));
+    t->tm_year = yoe + era * 400 + (m <= 2) - 1900;
+    t->tm_mon = m - 1;
+    t->tm_mday = doy - (153 * mp + 2) / 5 + 1;
+    t->tm_hour = 12;
+}
+
+/* local time - UTC at T, in seconds */
+static long utc_offset(time_t t)
+{
+    const struct tm *lt = localtime(&t);
+    if(!lt)
+        return LONG_MIN;
+    return days_from_civil(lt->tm_year + 1900L, lt->tm_mon + 1, lt->tm_mday)
+        * 86400L + lt->tm_hour * 3600L + lt->tm_min * 60L + lt->tm_sec
+        - (long)t;
+}
+
+static const day_offset *get_day_offset(long day, int isdst)
+{
+    day_offset *o = &parse_time.offsets[(unsigned long)day % DAY_OFFSETS];
+    if(o->valid && o->day == day && o->isdst == isdst)
+        return o;
+
+    o->valid = true;
+    o->day = day;
+    o->isdst = isdst;
+    o->constant = false;
+
+    struct tm t;
+    civil_from_days(day, &t);
+    t.tm_isdst = isdst;
+    const time_t noon = mktime(&t);
+    if(noon == (time_t)-1)
+        return o;
+    o->offset = day * 86400L + 12 * 3600L - (long)noon;
+
+    /* no DST change or other offset change from a bit before the day
+     * starts to a bit after it ends, so there are no skipped or
+     * repeated times that mktime() may handle in its own way
+     */
+    const long off = utc_offset(noon);
+    o->constant = off != LONG_MIN
+        && utc_offset(day * 86400L - off - 2 * 3600L) == off
+        && utc_offset(day * 86400L + 86400L - off + 2 * 3600L) == off;
+    return o;
+}
+
+/* mktime(), but without changing MT; uses the day offsets while
+ * parsing a listing
+ */
+static time_t local_mktime(const struct tm *mt)
+{
+    struct tm t = *mt;
+
+    if(parse_time.listing && mt->tm_sec == 0) {
+        long year = mt->tm_year + 1900L, mon = mt->tm_mon;
+        year += mon / 12;
+        mon %= 12;
+        if(mon < 0) {
+            mon += 12;
+            year--;
+        }
+        if(year > 0 && year < 10000 && mt->tm_mday > -1000
+           && mt->tm_mday < 1000)
+        {
+            const long day = days_from_civil(year, mon + 1, 1)
+                + mt->tm_mday - 1;
+            const long secs = mt->tm_hour * 3600L + mt->tm_min * 60L;
+            const day_offset *o = get_day_offset(day, mt->tm_isdst);
+            /* the time must be on that day, or the offset could differ */
+            if(o->constant && secs >= 0 && secs < 86400L)
+                return (time_t)(day * 86400L + secs - o->offset);
+        }
+    }
+
+    return mktime(&t);
+}
+
 void rfile_parse_time(rfile *f, const char *m, const char *d, const char *y)
 {
     time_t now;
-    struct tm *tm_now;
+    struct tm tm_now;
     struct tm mt;
     int u;
 
@@ -213,9 +365,8 @@ void rfile_parse_time(rfile *f, const char *m, const char *d, const char *y)
     if(mt.tm_mon == -1)
         return;
 
-    time(&now);
-    tm_now = localtime(&now);
-    mt.tm_isdst = tm_now->tm_isdst;
+    now = parse_now(&tm_now);
+    mt.tm_isdst = tm_now.tm_isdst;
 
     if(strchr(y, ':') != 0) {
         /* date on form "MMM DD HH:MM" */
@@ -230,16 +381,24 @@ void rfile_parse_time(rfile *f, const char *m, const char *d, const char *y)
             return;
         mt.tm_min = u;
 
-        mt.tm_year = tm_now->tm_year;
+        mt.tm_year = tm_now.tm_year;
         /* might be wrong year, +- 1
          * filetime is not older than 6 months
          * or newer than 1 hour
          */
+        tmp = local_mktime(&mt);
+        if(tmp <= now + 60L*60L && tmp >= now - 6L*30L*24L*60L*60L) {
+            f->mtime = tmp;
+            return;
+        }
+        /* mktime() normalizes mt, which the next call depends on */
         tmp = mktime(&mt);
         if(tmp > now + 60L*60L)
             mt.tm_year--;
         if(tmp < now - 6L*30L*24L*60L*60L)
             mt.tm_year++;
+        f->mtime = mktime(&mt);
+        return;
     } else {
         /* date on form "MMM DD YYYY" */
         char *ey;
@@ -250,21 +409,93 @@ void rfile_parse_time(rfile *f, const char *m, const char *d, const char *y)
         mt.tm_hour = 0;
         mt.tm_min = 0;
     }
-    f->mtime = mktime(&mt);
+    f->mtime = local_mktime(&mt);
 }
 
-#define NEXT_FIELD \
-e = strqsep(&cf, ' '); \
-if(!e || !*e) { \
-    return -1; \
+/* a field of a listing line, not nul terminated */
+typedef struct span {
+    const char *p;
+    size_t n;
+} span;
+
+/* like strqsep(), but doesn't modify the string: puts the next field
+ * before END, separated by DELIM, in SP and advances *S past it
+ * returns false if there are no more fields
+ */
+static bool span_sep(const char **s, const char *end, char delim, span *sp)
+{
+    const char *e = *s;
+    const char *b;
+    bool inquote = false;
+    char quote_char = '?';
+
+    while(e < end && *e == delim)
+        e++;
+    if(e >= end)
+        return false;
+    b = e;
+    while(e < end) {
+        if(*e == '\\') {
+            e++;
+            if(e >= end) break;
+            e++;
+            continue;
+        }
+        if(*e == '\"') {
+            if(inquote) {
+                if(quote_char == '\"')
+                    inquote = false;
+            } else {
+                inquote = true;
+                quote_char = '\"';
+            }
+        }
+        if(*e == '\'') {
+            if(inquote) {
+                if(quote_char == '\'')
+                    inquote = false;
+            } else {
+                inquote = true;
+                quote_char = '\'';
+            }
+        }
+        else if(*e == delim && !inquote)
+            break;
+        e++;
+    }
+    sp->p = b;
+    sp->n = e - b;
+    *s = e + (e < end ? 1 : 0);
+    return true;
+}
+
+#define SPAN_MAX 32
+
+/* copies SP to BUF (truncated to SPAN_MAX-1 chars), for sscanf() etc */
+static const char *span_str(char *buf, span sp)
+{
+    const size_t n = sp.n < SPAN_MAX - 1 ? sp.n : SPAN_MAX - 1;
+    memcpy(buf, sp.p, n);
+    buf[n] = 0;
+    return buf;
+}
+
+static bool span_is(span sp, const char *str)
+{
+    return strlen(str) == sp.n && strncasecmp(sp.p, str, sp.n) == 0;
 }
 
-#define NEXT_FIELD2 \
-e = strqsep(&cf, ' '); \
-if(!e || !*e) { \
-    free(m); \
-    free(d); \
-    free(y); \
+static int span_month(span sp)
+{
+    char buf[SPAN_MAX];
+
+    if(sp.n != 3)
+        return -1;
+    return month_number(span_str(buf, sp));
+}
+
+#define NEXT_FIELD \
+if(!span_sep(&cf, end, ' ', &e)) { \
     return -1; \
 }
 
@@ -294,11 +525,12 @@ char *time_to_string(time_t t)
     return ret;
 }
 
-static int rfile_parse_eplf(rfile *f, char *str, const char *dirpath)
+static int rfile_parse_eplf(rfile *f, const char *str, const char *end,
+                            const char *dirpath)
 {
-    char *e;
+    span e;
 
-    if(!str || str[0] != '+')
+    if(str[0] != '+')
         return -1;
 
     str++;
@@ -319,42 +551,42 @@ static int rfile_parse_eplf(rfile *f, char *str, const char *dirpath)
     free(f->path);
     f->path = NULL;
 
-    while((e = strqsep(&str, ',')) != 0) {
-        switch(*e) {
+    while(span_sep(&str, end, ',', &e)) {
+        switch(*e.p) {
         case '/':
             f->perm[0] = 'd';
             break;
         case 'm':
-            f->mtime = strtoul(e+1, 0, 10);
+            f->mtime = strtoul(e.p+1, 0, 10);
             free(f->date);
             f->date = time_to_string(f->mtime);
             break;
         case 's':
-            f->size = strtoull(e+1, 0, 10);
+            f->size = strtoull(e.p+1, 0, 10);
             break;
         case '\t':
-            if (asprintf(&f->path, "%s/%s",
-                     strcmp(dirpath, "/") ? dirpath : "", e+1) == -1)
+            if (asprintf(&f->path, "%s/%.*s",
+                     strcmp(dirpath, "/") ? dirpath : "",
+                     (int)e.n - 1, e.p+1) == -1)
               f->path = NULL;
             break;
         }
     }
     if (!f->path)
         return -1;
-    rfile_parse_colors(f);
-
     return 0;
 }
 
 /* This is a total mess!
  */
-static int rfile_parse_unix(rfile *f, char *str, const char *dirpath)
+static int rfile_parse_unix(rfile *f, const char *str, const char *end,
+                            const char *dirpath)
 {
-    char *cf = NULL;
-    char *e = NULL;
-    char *m = NULL, *d = NULL, *y = NULL;
-    char *saved_field[5] = { NULL };
+    const char *cf = NULL;
+    span e, m, d, y;
+    span saved_field[5];
     bool time_parsed = false;
+    char buf[SPAN_MAX];
 
     /* real unix ls listing:
      *
@@ -408,9 +640,12 @@ static int rfile_parse_unix(rfile *f, char *str, const char *dirpath)
      * ----------^
      * so we assume the permission string is exactly 10 characters
      */
-    free(f->perm);
-    f->perm = xstrndup(cf, 10);
-    cf += 10;
+    {
+        const size_t n = end - cf < 10 ? (size_t)(end - cf) : 10;
+        free(f->perm);
+        f->perm = xstrndup(cf, n);
+        cf += n;
+    }
 
     /* drwxr-s---+ 78 0        228         1536 Jul 10 15:36 private
      */
@@ -418,90 +653,81 @@ static int rfile_parse_unix(rfile *f, char *str, const char *dirpath)
        ++cf;
 
     NEXT_FIELD;
-    saved_field[0] = xstrdup(e);
+    saved_field[0] = e;
 
     NEXT_FIELD;
-    saved_field[1] = xstrdup(e);
+    saved_field[1] = e;
 
     NEXT_FIELD;
-    saved_field[2] = xstrdup(e);
+    saved_field[2] = e;
 
     NEXT_FIELD;
     /* special device? */
-    if(e[strlen(e)-1] == ',') {
+    if(e.p[e.n-1] == ',') {
         NEXT_FIELD;
     }
-    saved_field[3] = xstrdup(e);
+    saved_field[3] = e;
 
     NEXT_FIELD;
-    saved_field[4] = xstrdup(e);
+    saved_field[4] = e;
 
     /* distinguish the different ls variants by looking
      * for the month field
      */
 
-    if(month_number(saved_field[4]) != -1)
+    if(span_month(saved_field[4]) != -1)
     {
         /* ls -l */
-        f->nhl = atoi(saved_field[0]);
-        free(saved_field[0]);
+        f->nhl = atoi(saved_field[0].p);
         free(f->owner);
-        f->owner = saved_field[1];
+        f->owner = xstrndup(saved_field[1].p, saved_field[1].n);
         free(f->group);
-        f->group = saved_field[2];
-        f->size = strtoull(saved_field[3],NULL,10);
-        free(saved_field[3]);
+        f->group = xstrndup(saved_field[2].p, saved_field[2].n);
+        f->size = strtoull(saved_field[3].p,NULL,10);
         m = saved_field[4];
-        NEXT_FIELD2;
-        d = xstrdup(e);
-        NEXT_FIELD2;
-        y = xstrdup(e);
-    } else if(month_number(saved_field[3]) != -1)
+        NEXT_FIELD;
+        d = e;
+        NEXT_FIELD;
+        y = e;
+    } else if(span_month(saved_field[3]) != -1)
     {
         /* ls -lG */
-        f->nhl = atoi(saved_field[0]);
-        free(saved_field[0]);
+        f->nhl = atoi(saved_field[0].p);
         free(f->owner);
-        f->owner = saved_field[1];
+        f->owner = xstrndup(saved_field[1].p, saved_field[1].n);
         free(f->group);
         f->group = xstrdup("group");
-        f->size = strtoull(saved_field[2],NULL,10);
-        free(saved_field[2]);
+        f->size = strtoull(saved_field[2].p,NULL,10);
         m = saved_field[3];
         d = saved_field[4];
-        NEXT_FIELD2;
-        y = xstrdup(e);
-    } else if(month_number(saved_field[2]) != -1)
+        NEXT_FIELD;
+        y = e;
+    } else if(span_month(saved_field[2]) != -1)
     {
-        free(saved_field[0]);
         f->nhl = 0;
         free(f->owner);
         f->owner = xstrdup("owner");
         free(f->group);
         f->group = xstrdup("group");
-        f->size = strtoull(saved_field[1],NULL,10);
-        free(saved_field[1]);
+        f->size = strtoull(saved_field[1].p,NULL,10);
         m = saved_field[2];
         d = saved_field[3];
         y = saved_field[4];
     } else {
         int iy, im, id, ih = 0, imin = 0;
-        if(sscanf(saved_field[4], "%d-%d-%d", &iy, &im, &id) == 3) {
+        if(sscanf(span_str(buf, saved_field[4]), "%d-%d-%d", &iy, &im, &id) == 3) {
             /* date on the form YYYY-MM-DD */
             im -= 1; /* should be 0-based */
 
-            f->nhl = atoi(saved_field[0]);
-            free(saved_field[0]);
+            f->nhl = atoi(saved_field[0].p);
             free(f->owner);
-            f->owner = saved_field[1];
+            f->owner = xstrndup(saved_field[1].p, saved_field[1].n);
             free(f->group);
-            f->group = saved_field[2];
-            f->size = strtoull(saved_field[3],NULL,10);
-            free(saved_field[3]);
-            free(saved_field[4]);
+            f->group = xstrndup(saved_field[2].p, saved_field[2].n);
+            f->size = strtoull(saved_field[3].p,NULL,10);
 
-            e = strqsep(&cf, ' '); /* HH:MM */
-            sscanf(e, "%d:%d", &ih, &imin);
+            if(span_sep(&cf, end, ' ', &e)) /* HH:MM */
+                sscanf(span_str(buf, e), "%d:%d", &ih, &imin);
 
             {
                 struct tm mt;
@@ -517,9 +743,9 @@ static int rfile_parse_unix(rfile *f, char *str, const char *dirpath)
                 mt.tm_year = iy;
                 mt.tm_isdst = -1;
 
-                f->mtime = mktime(&mt);
+                f->mtime = local_mktime(&mt);
 
-                time(&now);
+                now = parse_now(0);
 
                 free(f->date);
                 bool success = true;
@@ -539,64 +765,52 @@ static int rfile_parse_unix(rfile *f, char *str, const char *dirpath)
 
                 time_parsed = true;
             }
-        } else {
-            free(saved_field[0]);
-            free(saved_field[1]);
-            free(saved_field[2]);
-            free(saved_field[3]);
-            free(saved_field[4]);
+        } else
             return -1;
-        }
     }
 
     if(!time_parsed) {
+        char mbuf[SPAN_MAX], dbuf[SPAN_MAX];
+
         free(f->date);
-        if (asprintf(&f->date, "%s %2s %5s", m, d, y) == -1)
+        if (asprintf(&f->date, "%.*s %2.*s %5.*s", (int)m.n, m.p,
+                     (int)d.n, d.p, (int)y.n, y.p) == -1)
         {
-          free(m);
-          free(d);
-          free(y);
           f->date = NULL;
           return -1;
         }
-        rfile_parse_time(f, m, d, y);
+        rfile_parse_time(f, span_str(mbuf, m), span_str(dbuf, d),
+                         span_str(buf, y));
         if(f->mtime == (time_t)-1)
             ftp_trace("rfile_parse_time failed! date == '%s'\n", f->date);
-        free(m);
-        free(d);
-        free(y);
     }
 
-    if(!cf)
-        return -1;
-
-    e = strstr(cf, " -> ");
-    if(e) {
-        *e = 0;
-        free(f->link);
-        f->link = xstrdup(e+4);
-    }
+    const char *link = strstr(cf, " -> ");
+    free(f->link);
+    f->link = link ? xstrdup(link+4) : NULL;
 
     free(f->path);
-    if (asprintf(&f->path, "%s/%s", strcmp(dirpath, "/") ? dirpath : "", cf) == -1)
+    if (asprintf(&f->path, "%s/%.*s", strcmp(dirpath, "/") ? dirpath : "",
+                 (int)((link ? link : end) - cf), cf) == -1)
     {
       f->path = NULL;
       return -1;
     }
 
-    rfile_parse_colors(f);
-
     return 0;
 }
 
-static int rfile_parse_dos(rfile *f, char *str, const char *dirpath)
+static int rfile_parse_dos(rfile *f, const char *str, const char *end,
+                           const char *dirpath)
 {
-    char *e, *cf = str;
+    const char *cf = str;
+    span e;
+    char buf[SPAN_MAX];
     char ampm[3]="xx";
     int m, d, y, h, mm;
 
     NEXT_FIELD;
-    if(sscanf(e, "%d-%d-%d", &m, &d, &y) != 3)
+    if(sscanf(span_str(buf, e), "%d-%d-%d", &m, &d, &y) != 3)
         return -1;
     m--;
 
@@ -604,7 +818,7 @@ static int rfile_parse_dos(rfile *f, char *str, const char *dirpath)
         y += 100;
 
     NEXT_FIELD;
-    if(sscanf(e, "%d:%2d%2s", &h, &mm, ampm) != 3)
+    if(sscanf(span_str(buf, e), "%d:%2d%2s", &h, &mm, ampm) != 3)
         return -1;
 
     if(strcasecmp(ampm, "PM") == 0)
@@ -623,12 +837,11 @@ static int rfile_parse_dos(rfile *f, char *str, const char *dirpath)
         mt.tm_year = y;
         mt.tm_isdst = -1;
 
-        f->mtime = mktime(&mt);
+        f->mtime = local_mktime(&mt);
     }
 
     {
-        time_t now;
-        time(&now);
+        time_t now = parse_now(0);
 
         free(f->date);
         bool success = true;
@@ -651,11 +864,11 @@ static int rfile_parse_dos(rfile *f, char *str, const char *dirpath)
     f->perm = xstrdup("-rw-r--r--");
 
     NEXT_FIELD;
-    if(strcasecmp(e, "<DIR>") == 0) {
+    if(span_is(e, "<DIR>")) {
         f->perm[0] = 'd';
         f->size = 0L;
     } else {
-        f->size = strtoull(e,NULL,10);
+        f->size = strtoull(e.p,NULL,10);
     }
 
     f->nhl = 1;
@@ -666,7 +879,7 @@ static int rfile_parse_dos(rfile *f, char *str, const char *dirpath)
     free(f->link);
     f->link = NULL;
 
-    while(cf && *cf == ' ')
+    while(*cf == ' ')
         ++cf;
 
     free(f->path);
@@ -676,32 +889,28 @@ static int rfile_parse_dos(rfile *f, char *str, const char *dirpath)
       return -1;
     }
 
-    rfile_parse_colors(f);
-
     return 0;
 }
 
 /* type=cdir;sizd=4096;modify=20010528094249;UNIX.mode=0700;UNIX.uid=1000;UNIX.gid=1000;unique=1642g7c81 .
  */
 
-static int rfile_parse_mlsd(rfile *f, char *str, const char *dirpath)
+static int rfile_parse_mlsd(rfile *f, const char *str, const char *dirpath)
 {
-    char *e;
+    span e;
     bool isdir = false;
+    char buf[SPAN_MAX];
 
-    if(!str)
-        return -1;
-
-    e = strchr(str, ' ');
-    if(e) {
+    /* the facts end at the first space, followed by the filename */
+    const char *end = strchr(str, ' ');
+    if(end) {
       free(f->path);
       if (asprintf(&f->path, "%s/%s",
-                 strcmp(dirpath, "/") ? dirpath : "", base_name_ptr(e+1)) == -1)
+                 strcmp(dirpath, "/") ? dirpath : "", base_name_ptr(end+1)) == -1)
       {
         f->path = NULL;
         return -1;
       }
-        *e = 0;
     } else
         return -1;
 
@@ -719,34 +928,34 @@ static int rfile_parse_mlsd(rfile *f, char *str, const char *dirpath)
     free(f->date);
     f->date = xstrdup("Jan  0  1900");
 
-    while((e = strqsep(&str, ';')) != 0) {
-        char *factname, *value;
+    while(span_sep(&str, end, ';', &e)) {
+        span factname, value;
+        const char *v = e.p;
 
-        factname = strqsep(&e, '=');
-        value = e;
-
-        if(!factname || !value) {
+        if(!span_sep(&v, e.p + e.n, '=', &factname)) {
             return -1;
         }
+        value.p = v;
+        value.n = e.p + e.n - v;
 
-        if(strcasecmp(factname, "size") == 0 ||
-            strcasecmp(factname, "sizd") == 0)
+        if(span_is(factname, "size") ||
+            span_is(factname, "sizd"))
             /* the "sizd" fact is not standardized in "Extension to
              * FTP" Internet draft, but PureFTPd uses it for some
              * reason for size of directories
              */
-            f->size = strtoull(value,NULL,10);
-        else if(strcasecmp(factname, "type") == 0) {
-            if(strcasecmp(value, "file") == 0)
+            f->size = strtoull(value.p,NULL,10);
+        else if(span_is(factname, "type")) {
+            if(span_is(value, "file"))
                 isdir = false;
-            else if(strcasecmp(value, "dir") == 0 ||
-                    strcasecmp(value, "cdir") == 0 ||
-                    strcasecmp(value, "pdir") == 0)
+            else if(span_is(value, "dir") ||
+                    span_is(value, "cdir") ||
+                    span_is(value, "pdir"))
                 isdir = true;
-        } else if(strcasecmp(factname, "modify") == 0) {
+        } else if(span_is(factname, "modify")) {
             struct tm ts;
 
-            sscanf(value, "%04d%02d%02d%02d%02d%02d",
+            sscanf(span_str(buf, value), "%04d%02d%02d%02d%02d%02d",
                    &ts.tm_year, &ts.tm_mon, &ts.tm_mday,
                    &ts.tm_hour, &ts.tm_min, &ts.tm_sec);
             ts.tm_year -= 1900;
@@ -754,15 +963,15 @@ static int rfile_parse_mlsd(rfile *f, char *str, const char *dirpath)
             f->mtime = gmt_mktime(&ts);
             free(f->date);
             f->date = time_to_string(f->mtime);
-        } else if(strcasecmp(factname, "UNIX.mode") == 0) {
+        } else if(span_is(factname, "UNIX.mode")) {
             free(f->perm);
-            f->perm = perm2string(strtoul(value, 0, 8));
-        } else if(strcasecmp(factname, "UNIX.gid") == 0) {
+            f->perm = perm2string(strtoul(value.p, 0, 8));
+        } else if(span_is(factname, "UNIX.gid")) {
             free(f->group);
-            f->group = xstrdup(value);
-        } else if(strcasecmp(factname, "UNIX.uid") == 0) {
+            f->group = xstrndup(value.p, value.n);
+        } else if(span_is(factname, "UNIX.uid")) {
             free(f->owner);
-            f->owner = xstrdup(value);
+            f->owner = xstrndup(value.p, value.n);
         }
     }
 
@@ -772,37 +981,94 @@ static int rfile_parse_mlsd(rfile *f, char *str, const char *dirpath)
     if(isdir)
         f->perm[0] = 'd';
 
-    rfile_parse_colors(f);
+    return 0;
+}
+
+/* LIST output format last seen from each server, so it needn't be
+ * found again on the next connection
+ */
+typedef struct list_type_host {
+    char *hostname;
+    int port;
+    LIST_t type;
+} list_type_host;
+
+static list *list_types = NULL;
 
+static int list_type_host_destroy(list_type_host *lth)
+{
+    free(lth->hostname);
+    free(lth);
     return 0;
 }
 
-int rfile_parse(rfile *f, char *str, const char *dirpath, bool is_mlsd)
+static list_type_host *list_type_host_find(void)
+{
+    if(!ftp->url || !ftp->url->hostname || !list_types)
+        return NULL;
+
+    listitem *li;
+    for(li = list_types->first; li; li = li->next) {
+        list_type_host *lth = (list_type_host *)li->data;
+        if(lth->port == ftp->url->port
+           && strcasecmp(lth->hostname, ftp->url->hostname) == 0)
+            return lth;
+    }
+    return NULL;
+}
+
+static void list_type_remember(void)
+{
+    if(!ftp->url || !ftp->url->hostname)
+        return;
+
+    list_type_host *lth = list_type_host_find();
+    if(!lth) {
+        if(!list_types)
+            list_types = list_new((listfunc)list_type_host_destroy);
+        lth = xmalloc(sizeof(list_type_host));
+        lth->hostname = xstrdup(ftp->url->hostname);
+        lth->port = ftp->url->port;
+        list_additem(list_types, lth);
+    }
+    lth->type = ftp->LIST_type;
+}
+
+/* guesses the LIST output format from a line of it */
+static LIST_t list_type_guess(const char *str)
+{
+    if(str[0] == '+')
+        return ltEplf;
+    /* MM-DD-YY */
+    if(isdigit((unsigned char)str[0]) && isdigit((unsigned char)str[1])
+       && str[2] == '-')
+        return ltDos;
+    return ltUnix;
+}
+
+int rfile_parse(rfile *f, const char *str, const char *dirpath, bool is_mlsd)
 {
     int i;
     int r = -1;
 
-    if(is_mlsd) {
-        char *tmp = xstrdup(str);
-        r = rfile_parse_mlsd(f, tmp, dirpath);
-        free(tmp);
-        return r;
-    }
+    if(is_mlsd)
+        return rfile_parse_mlsd(f, str, dirpath);
 
-    if(ftp->LIST_type == ltUnknown)
-        ftp->LIST_type = ltUnix;
+    const char *end = str + strlen(str);
+    const LIST_t prev_type = ftp->LIST_type;
 
-    for(i=0;i<3;i++) {
-        char *tmp = xstrdup(str);
+    if(ftp->LIST_type == ltUnknown) {
+        const list_type_host *lth = list_type_host_find();
+        ftp->LIST_type = lth ? lth->type : list_type_guess(str);
+    }
 
+    for(i=0;i<3;i++) {
         if(ftp->LIST_type == ltUnix)
-            r = rfile_parse_unix(f, tmp, dirpath);
+            r = rfile_parse_unix(f, str, end, dirpath);
         else if(ftp->LIST_type == ltDos)
-            r = rfile_parse_dos(f, tmp, dirpath);
+            r = rfile_parse_dos(f, str, end, dirpath);
         else if(ftp->LIST_type == ltEplf)
-            r = rfile_parse_eplf(f, tmp, dirpath);
-
-        free(tmp);
+            r = rfile_parse_eplf(f, str, end, dirpath);
 
         if(r == -1) {
             rfile_clear(f);
@@ -817,8 +1083,11 @@ int rfile_parse(rfile *f, char *str, const char *dirpath, bool is_mlsd)
                 ftp->LIST_type = ltUnix;
                 ftp_trace("EPLF output parsing failed, trying UNIX\n");
             }
-        } else
+        } else {
+            if(ftp->LIST_type != prev_type)
+                list_type_remember();
             return r;
+        }
     }
 
     return -1;
@@ -20,7 +20,6 @@ typedef struct rfile
   char *perm;
   char *owner;
   char *group;
-  char *color;
   char *date;         /* date and time as a string */
   time_t mtime;       /* modification time */
   unsigned int nhl;   /* number of hard links */
@@ -45,10 +44,12 @@ bool risblockdev(const rfile *f);
 bool rislink(const rfile *f);
 
 void rfile_fake(rfile *f, const char *path);
-int rfile_parse(rfile *f, char *str, const char *dirpath, bool is_mlsd);
-void rfile_parse_colors(rfile *f);
+int rfile_parse(rfile *f, const char *str, const char *dirpath, bool is_mlsd);
+const char *rfile_color(const rfile *f);
 
 int month_number(const char *str);
+void rfile_parse_begin(void);
+void rfile_parse_end(void);
 void rfile_parse_time(rfile *f, const char *m, const char *d, const char *y);
 
 char rfile_classchar(const rfile *f);
@@ -13,6 +13,7 @@
 #include "syshdr.h"
 #include "ftp.h"
 #include "strq.h"
+#include "gvars.h"
 
 list *rglob_create(void)
 {
@@ -29,6 +30,48 @@ bool rglob_exclude_dotdirs(rfile *f)
 	return risdotdir(f);
 }
 
+/* appends a copy of FI to GL, unless EXCLUDE_FUNC returns true for it or
+ * IGNORE_MULTIPLES is true and it already is in GL
+ */
+static void rglob_add(list *gl, rfile *fi, bool ignore_multiples,
+					  rglobfunc exclude_func)
+{
+	bool ignore_item;
+
+	/* call the exclude function, if any, and skip file
+		if the function returns true
+	*/
+	if(exclude_func && exclude_func(fi))
+		ignore_item = true;
+	else
+		ignore_item =
+			(ignore_multiples &&
+			 (list_search(gl, (listsearchfunc)rfile_search_path,
+							  fi->path) != 0));
+
+	if(!ignore_item)
+		list_additem(gl, (void *)rfile_clone(fi));
+	else
+		ftp_trace("ignoring file '%s'\n", fi->path);
+}
+
+/* returns true if MASK matches only the file named MASK
+ */
+static bool rglob_is_literal(const char *mask)
+{
+	return mask && *mask && !strpbrk(mask, "*?[\\")
+		&& strcmp(mask, ".") != 0 && strcmp(mask, "..") != 0;
+}
+
+/* returns true if MASK can be given to the server to match, it should
+ * only have the wildcards '*' and '?', and not match everything
+ */
+static bool rglob_server_can_match(const char *mask)
+{
+	return gvServerGlob && mask && *mask && *mask != '-'
+		&& strcmp(mask, "*") != 0 && !strpbrk(mask, "[\\ \t");
+}
+
 /* appends rglob items in list LP matching MASK
  * EXCLUDE_FUNC (if not 0) is called for each fileinfo item found
  * and that file is excluded if EXCLUDE_FUNC returns true
@@ -38,6 +81,10 @@ bool rglob_exclude_dotdirs(rfile *f)
  * if it already exists in the list
  *
  * any spaces or other strange characters in MASK should be backslash-quoted
+ *
+ * a MASK without wildcards is looked up by itself, so the directory
+ * doesn't have to be listed if the server has MLST, and with server_glob,
+ * simple wildcards are matched by the server if it can
  */
 int rglob_glob(list *gl, const char *mask, bool cpifnomatch,
 			   bool ignore_multiples, rglobfunc exclude_func)
@@ -65,39 +112,42 @@ int rglob_glob(list *gl, const char *mask, bool cpifnomatch,
 	if(!d) d = xstrdup(ftp->curdir);
 	else unquote(d);
 
-	rdir = ftp_get_directory(d);
-	free(d);
-
-	if(rdir) {
-		lip = rdir->files->first;
-		while(lip) {
-			fi = (rfile *)lip->data;
-			lip = lip->next;
-
-			/* check if the mask includes this file */
-			if(mp == 0 || fnmatch(mp, base_name_ptr(fi->path), 0)
-			   != FNM_NOMATCH)
-			{
-				bool ignore_item;
-
-				found++;
-
-				/* call the exclude function, if any, and skip file
-					if the function returns true
-				*/
-				if(exclude_func && exclude_func(fi))
-					ignore_item = true;
-				else
-					ignore_item =
-						(ignore_multiples &&
-						 (list_search(gl, (listsearchfunc)rfile_search_path,
-										  fi->path) != 0));
-
-				if(!ignore_item) {
-					nfi = rfile_clone(fi);
-					list_additem(gl, (void *)nfi);
-				} else
-					ftp_trace("ignoring file '%s'\n", fi->path);
+	if(rglob_is_literal(mp)) {
+		char *p;
+		if(asprintf(&p, "%s/%s", strcmp(d, "/") ? d : "", mp) == -1) {
+			free(d);
+			free(mp);
+			free(path);
+			return -1;
+		}
+		fi = ftp_get_file(p);
+		free(p);
+		if(fi) {
+			found++;
+			rglob_add(gl, fi, ignore_multiples, exclude_func);
+		}
+		free(d);
+	} else {
+		rdir = 0;
+		if(rglob_server_can_match(mp) && !ftp_cache_has_listing(d))
+			rdir = ftp_read_directory_matching(d, mp);
+		if(!rdir)
+			rdir = ftp_get_directory(d);
+		free(d);
+
+		if(rdir) {
+			lip = rdir->files->first;
+			while(lip) {
+				fi = (rfile *)lip->data;
+				lip = lip->next;
+
+				/* check if the mask includes this file */
+				if(mp == 0 || fnmatch(mp, base_name_ptr(fi->path), 0)
+				   != FNM_NOMATCH)
+				{
+					found++;
+					rglob_add(gl, fi, ignore_multiples, exclude_func);
+				}
 			}
 		}
 	}
@@ -108,6 +158,7 @@ int rglob_glob(list *gl, const char *mask, bool cpifnomatch,
 
 		if(!cpifnomatch || mp == 0 || *mp == 0) {
 			free(mp);
+			free(path);
 			return -1;
 		}
 		p = ftp_path_absolute(path);
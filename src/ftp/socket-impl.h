@@ -32,6 +32,12 @@ struct Socket_
   void (*lowdelay)(Socket *sockp);
   ssize_t (*read)(Socket *sockp, void *buf, size_t num);
   ssize_t (*write)(Socket *sockp, const void *buf, size_t num);
+  /* send NUM bytes from FD at *OFFSET without copying them, or fail with
+   * ENOSYS if the socket can't (may be 0) */
+  ssize_t (*sendfile)(Socket *sockp, int fd, off_t *offset, size_t num);
+  /* move up to NUM bytes to FD without copying them, or fail with ENOSYS
+   * if the socket can't (may be 0) */
+  ssize_t (*recvfile)(Socket *sockp, int fd, size_t num);
   int (*get)(Socket *sockp); /* get one character */
   int (*put)(Socket *sockp, int c); /* put one character */
   int (*vprintf)(Socket *sockp, const char *str, va_list ap);
@@ -41,6 +47,10 @@ struct Socket_
   int (*telnet_interrupt)(Socket *sockp);
 
   int (*check_pending)(Socket* sock, bool inout);
+  bool (*set_nonblocking)(Socket* sockp, bool on);
+  int (*set_bufsize)(Socket* sockp, int size);
+  long (*rtt)(Socket* sockp);
+  int (*handle)(Socket* sockp);
 
   void (*clear_error)(Socket* sockp, bool inout);
   int (*error)(Socket* sockp, bool input);
@@ -122,6 +122,28 @@ ssize_t sock_write(Socket *sockp, const void* buf, size_t num)
   return sockp->write(sockp, buf, num);
 }
 
+ssize_t sock_sendfile(Socket *sockp, int fd, off_t *offset, size_t num)
+{
+  if (!sockp || !sockp->sendfile)
+  {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  return sockp->sendfile(sockp, fd, offset, num);
+}
+
+ssize_t sock_recvfile(Socket *sockp, int fd, size_t num)
+{
+  if (!sockp || !sockp->recvfile)
+  {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  return sockp->recvfile(sockp, fd, num);
+}
+
 int sock_get(Socket *sockp)
 {
   if (!sockp || !sockp->get)
@@ -232,3 +254,35 @@ int sock_check_pending(Socket* sockp, bool inout)
 
   return sockp->check_pending(sockp, inout);
 }
+
+bool sock_set_nonblocking(Socket* sockp, bool on)
+{
+  if (!sockp || !sockp->set_nonblocking)
+    return false;
+
+  return sockp->set_nonblocking(sockp, on);
+}
+
+int sock_set_bufsize(Socket* sockp, int size)
+{
+  if (!sockp || !sockp->set_bufsize)
+    return -1;
+
+  return sockp->set_bufsize(sockp, size);
+}
+
+long sock_rtt(Socket* sockp)
+{
+  if (!sockp || !sockp->rtt)
+    return -1;
+
+  return sockp->rtt(sockp);
+}
+
+int sock_handle(Socket* sockp)
+{
+  if (!sockp || !sockp->handle)
+    return -1;
+
+  return sockp->handle(sockp);
+}
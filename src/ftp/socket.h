@@ -34,6 +34,8 @@ const struct sockaddr* sock_local_addr(Socket *sockp);
 const struct sockaddr* sock_remote_addr(Socket *sockp);
 ssize_t sock_read(Socket *sockp, void *buf, size_t num);
 ssize_t sock_write(Socket *sockp, const void *buf, size_t num);
+ssize_t sock_sendfile(Socket *sockp, int fd, off_t *offset, size_t num);
+ssize_t sock_recvfile(Socket *sockp, int fd, size_t num);
 int sock_get(Socket *sockp); /* get one character */
 int sock_put(Socket *sockp, int c); /* put one character */
 int sock_vprintf(Socket *sockp, const char *str, va_list ap);
@@ -51,5 +53,10 @@ void sock_clearerr_out(Socket* sockp);
 int sock_error_out(Socket* sockp);
 int sock_error_in(Socket* sockp);
 int sock_check_pending(Socket* sockp, bool inout);
+bool sock_set_nonblocking(Socket* sockp, bool on); /* false if not possible */
+/* sets send and receive buffers, returns the size in effect or -1 */
+int sock_set_bufsize(Socket* sockp, int size);
+long sock_rtt(Socket* sockp); /* round trip time in usec, or -1 */
+int sock_handle(Socket* sockp); /* underlying descriptor or -1 */
 
 #endif
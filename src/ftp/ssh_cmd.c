@@ -548,13 +548,13 @@ rdirectory* ssh_read_directory(const char *path)
     rf->mtime = attrib->mtime;
     rf->date = time_to_string(rf->mtime);
     rf->size = attrib->size;
-    rfile_parse_colors(rf);
 
     rf->link = NULL;
     if (rislink(rf) && ftp->ssh_version > 2)
       rf->link = sftp_readlink(ftp->sftp_session, rf->path);
 
-    list_additem(rdir->files, (void *)rf);
+    rdir_add_file(rdir, rf);
+    rfile_destroy(rf);
     sftp_attributes_free(attrib);
   }
   ftp_trace("*** end parsing directory listing ***\n");
@@ -572,7 +572,7 @@ rdirectory* ssh_read_directory(const char *path)
   rdir->path = p;
   rdir_sort(rdir);
   ftp_trace("added directory '%s' to cache\n", p);
-  list_additem(ftp->cache, rdir);
+  ftp_cache_add(rdir);
 
   return rdir;
 }
@@ -19,6 +19,7 @@
 #include "strq.h"
 #include "shortpath.h"
 #include "utils.h"
+#include "ftpwalk.h"
 
 #ifdef HAVE_REGEX_H
 # include <regex.h>
@@ -344,6 +345,7 @@ static void fxpfiles(list *gl, unsigned int opt, const char *output)
 {
 	listitem *li;
 	rfile *fp, *lnfp;
+	rfile *lncopy = 0;
 	const char *opath, *ofile;
 	char *link = 0;
 
@@ -354,7 +356,7 @@ static void fxpfiles(list *gl, unsigned int opt, const char *output)
 		fp = (rfile *)li->data;
 
 		if(!ftp_connected())
-			return;
+			break;
 
 		if(gvSighupReceived) {
 			if(!test(opt, FXP_RESUME))
@@ -418,7 +420,11 @@ static void fxpfiles(list *gl, unsigned int opt, const char *output)
 				continue;
 			}
 
-			fp = lnfp;
+			/* a copy, the cached directory can be removed from the cache
+			 * while reading subdirectories
+			 */
+			rfile_destroy(lncopy);
+			fp = lncopy = rfile_clone(lnfp);
 
 			if(rislink(fp))
 				/* found a link pointing to another link
@@ -513,6 +519,7 @@ static void fxpfiles(list *gl, unsigned int opt, const char *output)
 			}
 		}
 	}
+	rfile_destroy(lncopy);
 }
 
 void cmd_fxp(int argc, char **argv)
@@ -830,6 +837,8 @@ void cmd_fxp(int argc, char **argv)
 		exit(0);
 	}
 
+	if(test(opt, FXP_RECURSIVE))
+		ftp_walk_begin(gl);
 	if(list_numitem(gl))
 		fxpfiles(gl, opt, fxp_output);
 	rglob_destroy(gl);
@@ -20,6 +20,8 @@
 #include "commands.h"
 #include "utils/modechange.h"
 #include "utils.h"
+#include "ftppool.h"
+#include "ftpwalk.h"
 
 #ifdef HAVE_REGEX_H
 # include <regex.h>
@@ -55,6 +57,22 @@ static bool get_delbatch = false;
 static mode_change *cmod = 0;
 static gid_t group_change = -1;
 static bool get_skip_empty = false;
+static unsigned int get_segments = 0;
+static unsigned int get_parallel = 0;
+
+/* a file (or directory attributes) to get with --parallel */
+typedef struct get_job
+{
+    rfile *fi;
+    char *dest;
+    getmode_t how;
+    unsigned int opt;
+    bool isdir;     /* only preserve attributes of directory DEST */
+    char *tag;      /* path in ftp->taglist, untagged once received, or 0 */
+} get_job;
+
+/* list of get_job, collected by getfiles() when --parallel is given */
+static list *get_jobs = 0;
 
 static char *get_glob_mask = 0;
 static char *get_dir_glob_mask = 0;
@@ -94,6 +112,9 @@ static void print_get_syntax(void)
       "  -r, --recursive      get directories recursively\n"
       "  -R, --resume         resume broken download (restart at eof)\n"
       "  -s, --skip-existing  skip file if destination exists\n"
+      "      --segments=N     get each large file in N parts over N extra\n"
+      "                       connections at once\n"
+      "      --parallel=N     get up to N files at once over N extra connections\n"
       "  -S, --stats[=NUM]    set stats transfer threshold; default is always\n"
       "  -t, --tagged         transfer tagged file(s)\n"
       "      --type=TYPE      specify transfer type, 'ascii' or 'binary'\n"
@@ -110,6 +131,34 @@ static bool get_exclude_func(rfile *f)
     return false;
 }
 
+static transfer_mode_t get_transfer_type(const char *src, unsigned opt)
+{
+    transfer_mode_t type = ascii_transfer(src) ? tmAscii : gvDefaultType;
+
+    if(test(opt, GET_ASCII))
+        type = tmAscii;
+    else if(test(opt, GET_BINARY))
+        type = tmBinary;
+    return type;
+}
+
+/* reports the result of getting SRC in nohup mode */
+static void get_report(const char *src, int r, long long size,
+                       long long total_size, unsigned opt)
+{
+    if(r == 0 && (test(opt, GET_NOHUP) || gvSighupReceived)) {
+        fprintf(stderr, "%s [%sb of ", src, human_size(size));
+        fprintf(stderr, "%sb]\n", human_size(total_size));
+    }
+    if(test(opt, GET_NOHUP)) {
+        if(r == 0)
+            transfer_mail_msg(_("received %s\n"), src);
+        else
+            transfer_mail_msg(_("failed to receive %s: %s\n"),
+                              src, ftp_getreply(false));
+    }
+}
+
 /* just gets the file SRC and store in local file DEST
  * doesn't parse any LIST output
  * returns 0 on success, else -1
@@ -119,13 +168,7 @@ static int do_the_get(const char *src, const char *dest,
 {
     char *fulldest;
     char *tmp;
-    transfer_mode_t type;
-
-    type = ascii_transfer(src) ? tmAscii : gvDefaultType;
-    if(test(opt, GET_ASCII))
-        type = tmAscii;
-    else if(test(opt, GET_BINARY))
-        type = tmBinary;
+    transfer_mode_t type = get_transfer_type(src, opt);
 
     tmp = getcwd(NULL, 0);
     if (tmp == (char *)NULL)
@@ -138,23 +181,12 @@ static int do_the_get(const char *src, const char *dest,
         setproctitle("%s, get %s", ftp->url->hostname, src);
 #endif
 
-    int r = ftp_getfile(src, dest, how, type,
-                        test(opt, GET_VERBOSE)
-                        && !gvSighupReceived
-                        && !test(opt, GET_NOHUP) ? transfer : 0);
+    int r = ftp_getfile_segmented(src, dest, how, type, get_segments,
+                                  test(opt, GET_VERBOSE)
+                                  && !gvSighupReceived
+                                  && !test(opt, GET_NOHUP) ? transfer : 0);
 
-    if(r == 0 && (test(opt, GET_NOHUP) || gvSighupReceived)) {
-        fprintf(stderr, "%s [%sb of ",
-                src, human_size(ftp->ti.size));
-        fprintf(stderr, "%sb]\n", human_size(ftp->ti.total_size));
-    }
-    if(test(opt, GET_NOHUP)) {
-        if(r == 0)
-            transfer_mail_msg(_("received %s\n"), src);
-        else
-            transfer_mail_msg(_("failed to receive %s: %s\n"),
-                              src, ftp_getreply(false));
-    }
+    get_report(src, r, ftp->ti.size, ftp->ti.total_size, opt);
     free(fulldest);
 #if 0 && (defined(HAVE_SETPROCTITLE) || defined(linux))
     if(gvUseEnvString && ftp_connected())
@@ -166,7 +198,7 @@ static int do_the_get(const char *src, const char *dest,
     return r;
 }
 
-static void get_preserve_attribs(const rfile *fi, char *dest)
+static void get_preserve_attribs(const rfile *fi, const char *dest)
 {
     time_t t;
     mode_t m = rfile_getmode(fi);
@@ -186,8 +218,82 @@ static void get_preserve_attribs(const rfile *fi, char *dest)
     }
 }
 
+/* updates stats and does what the options say should be done with a
+ * successfully received file
+ */
+static void getfile_done(const rfile *fi, const char *dest, unsigned int opt,
+                         long long size)
+{
+    stats_file(STATS_SUCCESS, size);
+    if(test(opt, GET_PRESERVE))
+        get_preserve_attribs(fi, dest);
+    if(test(opt, GET_CHMOD)) {
+        mode_t m = rfile_getmode(fi);
+        m = mode_adjust(m, cmod);
+        if(chmod(dest, m) != 0)
+            perror(dest);
+    }
+    if(test(opt, GET_CHGRP)) {
+        if(chown(dest, -1, group_change) != 0)
+            perror(dest);
+    }
+    if(test(opt, GET_DELETE_AFTER)) {
+        bool dodel = false;
+        char* sp = shortpath(fi->path, 42, ftp->homedir);
+        if(!test(opt, GET_FORCE)
+           && !get_delbatch && !gvSighupReceived)
+        {
+            int a = ask(ASKYES|ASKNO|ASKCANCEL|ASKALL, ASKYES,
+                        _("Delete remote file '%s'?"), sp);
+            if(a == ASKALL) {
+                get_delbatch = true;
+                dodel = true;
+            }
+            else if(a == ASKCANCEL)
+                get_quit = true;
+            else if(a != ASKNO)
+                dodel = true;
+        } else
+            dodel = true;
+
+        if(dodel) {
+            ftp_unlink(fi->path);
+            if(ftp->code == ctComplete)
+                fprintf(stderr, _("%s: deleted\n"), sp);
+            else
+                fprintf(stderr, _("error deleting '%s': %s\n"),
+                            sp, ftp_getreply(false));
+        }
+        free(sp);
+    }
+}
+
+/* queues a job for the worker pool, see get_run_jobs() */
+static void get_queue(const rfile *fi, const char *dest, getmode_t how,
+                      unsigned int opt, bool isdir)
+{
+    get_job *job = xmalloc(sizeof(get_job));
+
+    job->fi = rfile_clone(fi);
+    job->dest = xstrdup(dest);
+    job->how = how;
+    job->opt = opt;
+    job->isdir = isdir;
+    job->tag = 0;
+    list_additem(get_jobs, job);
+}
+
+static void get_job_destroy(get_job *job)
+{
+    rfile_destroy(job->fi);
+    free(job->dest);
+    free(job->tag);
+    free(job);
+}
+
 /* returns:
  * 0   ok, remove file from list
+ * 1   queued for the worker pool, keep it in the list
  * -1  failure
  */
 static int getfile(const rfile *fi, unsigned int opt,
@@ -366,53 +472,17 @@ static int getfile(const rfile *fi, unsigned int opt,
             perror(dest);
         ret = 0;
     }
+    else if(get_jobs) {
+        /* received later by the worker pool */
+        get_queue(fi, dest, how, opt, false);
+        ret = 1;
+    }
     else {
         r = do_the_get(fi->path, dest, how, opt);
 
         if(r == 0) {
-			stats_file(STATS_SUCCESS, ftp->ti.total_size);
+            getfile_done(fi, dest, opt, ftp->ti.total_size);
             ret = 0;
-            if(test(opt, GET_PRESERVE))
-                get_preserve_attribs(fi, dest);
-            if(test(opt, GET_CHMOD)) {
-                mode_t m = rfile_getmode(fi);
-                m = mode_adjust(m, cmod);
-                if(chmod(dest, m) != 0)
-                    perror(dest);
-            }
-            if(test(opt, GET_CHGRP)) {
-                if(chown(dest, -1, group_change) != 0)
-                    perror(dest);
-            }
-            if(test(opt, GET_DELETE_AFTER)) {
-                bool dodel = false;
-								char* sp = shortpath(fi->path, 42, ftp->homedir);
-                if(!test(opt, GET_FORCE)
-                   && !get_delbatch && !gvSighupReceived)
-                {
-                    int a = ask(ASKYES|ASKNO|ASKCANCEL|ASKALL, ASKYES,
-                                _("Delete remote file '%s'?"), sp);
-                    if(a == ASKALL) {
-                        get_delbatch = true;
-                        dodel = true;
-                    }
-                    else if(a == ASKCANCEL)
-                        get_quit = true;
-                    else if(a != ASKNO)
-                        dodel = true;
-                } else
-                    dodel = true;
-
-                if(dodel) {
-                    ftp_unlink(fi->path);
-                    if(ftp->code == ctComplete)
-                        fprintf(stderr, _("%s: deleted\n"), sp);
-                    else
-                        fprintf(stderr, _("error deleting '%s': %s\n"),
-															  sp, ftp_getreply(false));
-                }
-								free(sp);
-            }
         } else {
 			stats_file(STATS_FAIL, 0);
 			ret = -1;
@@ -437,10 +507,32 @@ int get_sort_func(const void *a, const void *b)
    return tfb ? 1 : 0;
 }
 
+/* moves LI on to the next file in GL after getfile() returned R; a tagged
+ * file that was queued stays tagged until it is received
+ */
+static void get_nextfile(list *gl, listitem **li, int r)
+{
+    if(r == 1 && gl == ftp->taglist) {
+        get_job *job = (get_job *)get_jobs->last->data;
+        job->tag = xstrdup(((rfile *)(*li)->data)->path);
+    }
+    transfer_nextfile(gl, li, r == 0);
+}
+
+/* removes the file PATH from the tag list */
+static void get_untag(const char *path)
+{
+    listitem *li = list_search(ftp->taglist, (listsearchfunc)rfile_search_path,
+                               path);
+    if(li)
+        list_delitem(ftp->taglist, li);
+}
+
 static void getfiles(list *gl, unsigned int opt, const char *output)
 {
     listitem *li;
     rfile *fp, *lnfp;
+    rfile *lncopy = 0;
     const char *opath, *ofile;
     char *link = 0;
 
@@ -451,7 +543,7 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
         fp = (rfile *)li->data;
 
         if(!ftp_connected())
-            return;
+            break;
 
         if(gvSighupReceived) {
             if(!test(opt, GET_RESUME))
@@ -491,7 +583,7 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
             if(test(opt, GET_NO_DEREFERENCE)) {
                 /* link the file, don't copy */
                 const int r = getfile(fp, opt, output, ofile);
-                transfer_nextfile(gl, &li, r == 0);
+                get_nextfile(gl, &li, r);
                 continue;
             }
 
@@ -508,7 +600,7 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
                 /* couldn't dereference the link, try to RETR it */
                 ftp_trace("unable to dereference link\n");
                 const int r = getfile(fp, opt, output, ofile);
-                transfer_nextfile(gl, &li, r == 0);
+                get_nextfile(gl, &li, r);
                 continue;
             }
 
@@ -522,7 +614,11 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
                 continue;
             }
 
-            fp = lnfp;
+            /* a copy, the cached directory can be removed from the cache
+             * while reading subdirectories
+             */
+            rfile_destroy(lncopy);
+            fp = lncopy = rfile_clone(lnfp);
 
             if(rislink(fp))
                 /* found a link pointing to another link
@@ -577,8 +673,13 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
                         free(q_recurs_mask);
                         if(list_numitem(rgl) > 0)
                             getfiles(rgl, opt, recurs_output);
-                        if(test(opt, GET_PRESERVE))
-                            get_preserve_attribs(fp, recurs_output);
+                        if(test(opt, GET_PRESERVE)) {
+                            if(get_jobs)
+                                /* after the files in it are received */
+                                get_queue(fp, recurs_output, getNormal, opt, true);
+                            else
+                                get_preserve_attribs(fp, recurs_output);
+                        }
                         rglob_destroy(rgl);
                         free(recurs_output);
                     }
@@ -601,7 +702,7 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
         }
         const int r = getfile(fp, opt, output, ofile);
 
-        transfer_nextfile(gl, &li, r == 0);
+        get_nextfile(gl, &li, r);
 
         if(gvInterrupted) {
             gvInterrupted = false;
@@ -618,6 +719,116 @@ static void getfiles(list *gl, unsigned int opt, const char *output)
             }
         }
     }
+    rfile_destroy(lncopy);
+}
+
+static int get_job_func(unsigned int n, void *data, ftp_transfer_func hookf)
+{
+    const get_job *job = ((get_job **)data)[n];
+
+    if(job->isdir)
+        return 0;
+    return ftp_getfile_segmented(job->fi->path, job->dest, job->how,
+                                 get_transfer_type(job->fi->path, job->opt),
+                                 get_segments, hookf);
+}
+
+/* receives the files queued by getfiles() over a pool of get_parallel
+ * sessions, then finishes them here in the order they were queued
+ */
+static void get_run_jobs(unsigned int opt)
+{
+    const unsigned int n = list_numitem(get_jobs);
+    unsigned int i = 0, nfiles = 0;
+    long long total_size = 0;
+    listitem *li;
+    char *name;
+
+    if(n == 0)
+        return;
+
+    get_job **jobs = xmalloc(n * sizeof(get_job *));
+    for(li = get_jobs->first; li; li = li->next) {
+        get_job *job = (get_job *)li->data;
+        jobs[i++] = job;
+        if(!job->isdir) {
+            nfiles++;
+            total_size += job->fi->size;
+        }
+    }
+
+    if (asprintf(&name, _("%u files"), nfiles) == -1)
+    {
+        fprintf(stderr, _("Failed to allocate memory.\n"));
+        free(jobs);
+        return;
+    }
+
+    ftp_pool_result *res = ftp_pool_run(get_parallel, n, get_job_func, jobs,
+                                        name, name, total_size,
+                                        test(opt, GET_VERBOSE)
+                                        && !gvSighupReceived
+                                        && !test(opt, GET_NOHUP)
+                                        ? transfer : 0);
+    if(!res)
+        ftp_trace("no worker sessions, getting files one at a time\n");
+
+    for(i = 0; i < n && !get_quit; i++) {
+        const get_job *job = jobs[i];
+
+        if(job->isdir) {
+            if(!res || res[i].status == FTP_POOL_OK)
+                get_preserve_attribs(job->fi, job->dest);
+            continue;
+        }
+
+        if(!res) {
+            /* no extra sessions could be opened */
+            if(gvInterrupted)
+                break;
+            if(do_the_get(job->fi->path, job->dest, job->how, job->opt) == 0) {
+                getfile_done(job->fi, job->dest, job->opt, ftp->ti.total_size);
+                if(job->tag)
+                    get_untag(job->tag);
+            } else
+                stats_file(STATS_FAIL, 0);
+            continue;
+        }
+
+        if(res[i].status == FTP_POOL_NOTRUN)
+            continue;
+        stats_recovery(res[i].recoveries);
+        get_report(job->fi->path, res[i].status == FTP_POOL_OK ? 0 : -1,
+                   res[i].size, res[i].total_size, job->opt);
+        if(res[i].status == FTP_POOL_OK) {
+            getfile_done(job->fi, job->dest, job->opt, res[i].total_size);
+            if(job->tag)
+                get_untag(job->tag);
+        } else
+            stats_worker_file(STATS_FAIL, 0, res[i].worker);
+    }
+
+    free(res);
+    free(name);
+    free(jobs);
+}
+
+/* gets the files in GL, over a pool of sessions if --parallel is given */
+static void getfiles_all(list *gl, unsigned int opt, const char *output)
+{
+    if(get_parallel > 1)
+        get_jobs = list_new((listfunc)get_job_destroy);
+
+    if(list_numitem(gl))
+        getfiles(gl, opt, output);
+    if(ftp->taglist && test(opt, GET_TAGGED))
+        getfiles(ftp->taglist, opt, output);
+
+    if(get_jobs) {
+        get_run_jobs(opt);
+        list_free(get_jobs);
+        get_jobs = 0;
+    }
 }
 
 void cmd_get(int argc, char **argv)
@@ -661,6 +872,8 @@ void cmd_get(int argc, char **argv)
         {"recursive", no_argument, 0, 'r'},
         {"resume", no_argument, 0, 'R'},
         {"skip-existing", no_argument, 0, 's'},
+        {"segments", required_argument, 0, '5'},
+        {"parallel", required_argument, 0, '6'},
         {"stats", optional_argument, 0, 'S'},
         {"tagged", no_argument, 0, 't'},
         {"type", required_argument, 0, '1'},
@@ -695,6 +908,8 @@ void cmd_get(int argc, char **argv)
 #endif
 
     get_skip_empty = false;
+    get_segments = 0;
+    get_parallel = 0;
 
     optind = 0; /* force getopt() to re-initialize */
     while((c=getopt_long(argc, argv, "abHc:dDeio:fFL:tnpPvqrRsuT:m:M:",
@@ -820,6 +1035,20 @@ void cmd_get(int argc, char **argv)
           case 's':
             opt |= GET_SKIP_EXISTING;
             break;
+        case '5': /* --segments=N */
+            get_segments = parse_count(optarg, FTP_POOL_MAX_WORKERS);
+            if(get_segments == 0) {
+                printf(_("Invalid option argument --segments=%s\n"), optarg);
+                return;
+            }
+            break;
+        case '6': /* --parallel=N */
+            get_parallel = parse_count(optarg, FTP_POOL_MAX_WORKERS);
+            if(get_parallel == 0) {
+                printf(_("Invalid option argument --parallel=%s\n"), optarg);
+                return;
+            }
+            break;
           case 'S':
             stat_thresh = optarg ? atoi(optarg) : 0;
             break;
@@ -927,11 +1156,8 @@ void cmd_get(int argc, char **argv)
                 opt |= GET_UNIQUE;
             opt |= GET_FORCE;
 
-            if(list_numitem(gl))
-                getfiles(gl, opt, get_output);
+            getfiles_all(gl, opt, get_output);
             rglob_destroy(gl);
-            if(ftp->taglist && test(opt, GET_TAGGED))
-                getfiles(ftp->taglist, opt, get_output);
             free(get_output);
 
             transfer_end_nohup();
@@ -949,11 +1175,10 @@ void cmd_get(int argc, char **argv)
         exit(0);
     }
 
-    if(list_numitem(gl))
-        getfiles(gl, opt, get_output);
+    if(test(opt, GET_RECURSIVE))
+        ftp_walk_begin(gl);
+    getfiles_all(gl, opt, get_output);
     rglob_destroy(gl);
-    if(ftp->taglist && test(opt, GET_TAGGED))
-        getfiles(ftp->taglist, opt, get_output);
     free(get_output);
     mode_free(cmod);
     cmod = 0;
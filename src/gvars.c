@@ -18,6 +18,19 @@
 /* time (in seconds) before a cached directory times out, 0 == never */
 int gvCacheTimeout = 0;
 
+/* max number of cached directories / bytes used by them, 0 == no limit */
+unsigned gvCacheMaxDirs = 0;
+size_t gvCacheMaxMemory = 0;
+
+/* save the directory cache between sessions */
+bool gvPersistentCache = false;
+
+/* let the server match simple wildcards with "LIST mask" */
+bool gvServerGlob = false;
+
+/* extra sessions listing directory trees for recursive commands */
+unsigned gvPrefetchSessions = 0;
+
 /* list of Ftp objects */
 list *gvFtpList = 0;
 
@@ -148,6 +161,12 @@ unsigned int gvConnectAttempts = 10;
 
 unsigned int gvCommandTimeout = 42;
 unsigned int gvConnectionTimeout = 30;
+/* upper bound (in KiB) of data connection buffers, 0 disables autotuning */
+unsigned int gvAutotuneBufferMax = 0;
+/* a transfer slower than gvStallMinRate bytes/s for gvStallTimeout seconds
+ * is restarted on a new connection, 0 disables this */
+unsigned int gvStallTimeout = 0;
+unsigned int gvStallMinRate = 1;
 
 /* mailaddress to send mail to when nohup transfer is finished */
 char *gvNohupMailAddress = 0;
@@ -20,6 +20,11 @@
 
 /* time (in seconds) before a cached directory times out, 0 == never */
 extern int gvCacheTimeout;
+extern unsigned gvCacheMaxDirs;
+extern size_t gvCacheMaxMemory;
+extern bool gvPersistentCache;
+extern bool gvServerGlob;
+extern unsigned gvPrefetchSessions;
 
 /* list of Ftp objects */
 extern list *gvFtpList;
@@ -147,6 +152,9 @@ extern int gvConnectWaitTime;
 extern unsigned int gvConnectAttempts;
 extern unsigned int gvCommandTimeout;
 extern unsigned int gvConnectionTimeout;
+extern unsigned int gvAutotuneBufferMax;
+extern unsigned int gvStallTimeout;
+extern unsigned int gvStallMinRate;
 extern char *gvNohupMailAddress;
 extern char *gvSendmailPath;
 
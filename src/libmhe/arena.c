@@ -0,0 +1,191 @@
+/*
+ * arena.c -- allocate many small objects, free them all at once
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+#include "syshdr.h"
+
+#include "arena.h"
+#include "xmalloc.h"
+
+/* blocks start small, for small directories, and double up to this */
+#define ARENA_FIRST_BLOCK_SIZE 1024
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* everything is aligned for any type */
+typedef union arena_align {
+  long long l;
+  long double d;
+  void* p;
+} arena_align;
+
+#define ARENA_ALIGN(n) (((n) + sizeof(arena_align) - 1) \
+                        / sizeof(arena_align) * sizeof(arena_align))
+
+typedef struct arena_block arena_block;
+struct arena_block {
+  arena_block* next;
+  size_t used, size;
+  arena_align data[];
+};
+
+/* a string returned by arena_intern() */
+typedef struct intern_node intern_node;
+struct intern_node {
+  intern_node* next;
+  unsigned int hash;
+  char str[];
+};
+
+struct arena {
+  arena_block* blocks;    /* the one being filled first */
+  intern_node** interned; /* hash table of interned strings */
+  size_t nbuckets, ninterned;
+  size_t next_size;       /* size of the next block */
+  size_t bytes;           /* memory used by the blocks */
+};
+
+arena *arena_new(void)
+{
+  return xmalloc(sizeof(arena));
+}
+
+void arena_free(arena *a)
+{
+  if (!a)
+    return;
+
+  arena_block* b = a->blocks;
+  while (b)
+  {
+    arena_block* next = b->next;
+    free(b);
+    b = next;
+  }
+  free(a->interned);
+  free(a);
+}
+
+/* returns SIZE bytes of zeroed memory, owned by A */
+void *arena_alloc(arena *a, size_t size)
+{
+  size = ARENA_ALIGN(size ? size : 1);
+
+  arena_block* b = a->blocks;
+  if (!b || b->size - b->used < size)
+  {
+    const bool big = size > ARENA_BLOCK_SIZE / 4;
+    if (!a->next_size)
+      a->next_size = ARENA_FIRST_BLOCK_SIZE;
+    size_t bsize = a->next_size;
+    if (big || bsize < size)
+      bsize = size;
+    else if (a->next_size < ARENA_BLOCK_SIZE)
+      a->next_size *= 2;
+    arena_block* nb = xmalloc(sizeof(arena_block) + bsize);
+    nb->size = bsize;
+    a->bytes += sizeof(arena_block) + bsize;
+    if (b && big)
+    {
+      /* a big one, keep filling the current block */
+      nb->next = b->next;
+      b->next = nb;
+      nb->used = bsize;
+      return nb->data;
+    }
+    nb->next = b;
+    a->blocks = b = nb;
+  }
+
+  void* p = (char *)b->data + b->used;
+  b->used += size;
+  return p;
+}
+
+/* returns the memory used by A */
+size_t arena_size(const arena *a)
+{
+  return sizeof(arena) + a->bytes + a->nbuckets * sizeof(intern_node *);
+}
+
+char *arena_strdup(arena *a, const char *s)
+{
+  if (!s)
+    return NULL;
+
+  const size_t len = strlen(s) + 1;
+  char* p = arena_alloc(a, len);
+  memcpy(p, s, len);
+  return p;
+}
+
+/* FNV-1a */
+static unsigned int intern_hash(const char *s)
+{
+  unsigned int h = 2166136261u;
+  for (; *s; s++)
+  {
+    h ^= (unsigned char)*s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void intern_grow(arena *a)
+{
+  const size_t n = a->nbuckets ? a->nbuckets * 2 : 64;
+  intern_node** buckets = xmalloc(n * sizeof(intern_node *));
+
+  for (size_t i = 0; i < a->nbuckets; i++)
+  {
+    intern_node* node = a->interned[i];
+    while (node)
+    {
+      intern_node* next = node->next;
+      node->next = buckets[node->hash & (n - 1)];
+      buckets[node->hash & (n - 1)] = node;
+      node = next;
+    }
+  }
+  free(a->interned);
+  a->interned = buckets;
+  a->nbuckets = n;
+}
+
+/* like arena_strdup(), but equal strings share one copy, so they can be
+ * compared by pointer; the result must not be modified
+ */
+const char *arena_intern(arena *a, const char *s)
+{
+  if (!s)
+    return NULL;
+
+  const unsigned int h = intern_hash(s);
+  if (a->nbuckets)
+  {
+    for (intern_node* node = a->interned[h & (a->nbuckets - 1)]; node;
+         node = node->next)
+    {
+      if (node->hash == h && strcmp(node->str, s) == 0)
+        return node->str;
+    }
+  }
+
+  if (a->ninterned >= a->nbuckets)
+    intern_grow(a);
+
+  const size_t len = strlen(s) + 1;
+  intern_node* node = arena_alloc(a, sizeof(intern_node) + len);
+  node->hash = h;
+  memcpy(node->str, s, len);
+  node->next = a->interned[h & (a->nbuckets - 1)];
+  a->interned[h & (a->nbuckets - 1)] = node;
+  a->ninterned++;
+  return node->str;
+}
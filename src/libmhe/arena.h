@@ -0,0 +1,26 @@
+/*
+ * arena.h -- allocate many small objects, free them all at once
+ *
+ * Yet Another FTP Client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. See COPYING for more details.
+ */
+
+#ifndef _arena_h_included
+#define _arena_h_included
+
+#include <stddef.h>
+
+typedef struct arena arena;
+
+arena *arena_new(void);
+void arena_free(arena *a);
+void *arena_alloc(arena *a, size_t size);
+size_t arena_size(const arena *a);
+char *arena_strdup(arena *a, const char *s);
+const char *arena_intern(arena *a, const char *s);
+
+#endif
@@ -102,40 +102,58 @@ size_t list_numitem(list *lp)
   return lp->numitem;
 }
 
-static void list_swap(list *lp, listitem *a, listitem *b)
+/* merges the sorted runs A[0..MID-1] and A[MID..N-1] through TMP
+ * on equal items the one from the first run goes first, so it's stable
+ */
+static void merge(void **a, void **tmp, size_t mid, size_t n,
+                  listsortfunc cmp, bool reverse)
+{
+  size_t i = 0, j = mid, k = 0;
+
+  while (i < mid && j < n)
+  {
+    const int c = cmp(a[i], a[j]);
+    if (reverse ? c >= 0 : c <= 0)
+      tmp[k++] = a[i++];
+    else
+      tmp[k++] = a[j++];
+  }
+  while (i < mid)
+    tmp[k++] = a[i++];
+  while (j < n)
+    tmp[k++] = a[j++];
+  memcpy(a, tmp, n * sizeof(void *));
+}
+
+static void merge_sort(void **a, void **tmp, size_t n,
+                       listsortfunc cmp, bool reverse)
 {
-  if (!a || !b || a->data == b->data)
+  if (n < 2)
     return;
 
-  void* tmp = a->data;
-  a->data = b->data;
-  b->data = tmp;
+  const size_t mid = n / 2;
+  merge_sort(a, tmp, mid, cmp, reverse);
+  merge_sort(a + mid, tmp, n - mid, cmp, reverse);
+  merge(a, tmp, mid, n, cmp, reverse);
 }
 
-/* simple bubble-sort */
+/* stable merge sort of the data, the listitems stay where they are */
 void list_sort(list *lp, listsortfunc cmp, bool reverse)
 {
-  listitem *last = NULL;
-  bool swapped = true;
+  if (!lp || lp->numitem < 2)
+    return;
 
-  while (swapped)
-  {
-    swapped = false;
-    for (listitem* li = lp->first; li && li->next; li = li->next)
-    {
-      if (li->next == last)
-      {
-        last = li;
-        break;
-      }
-      const int c = cmp(li->data, li->next->data);
-      if (reverse ? c < 0 : c > 0)
-      {
-        list_swap(lp, li, li->next);
-        swapped = true;
-      }
-    }
-  }
+  void** a = xmalloc(lp->numitem * 2 * sizeof(void *));
+  size_t i = 0;
+  for (listitem* li = lp->first; li; li = li->next)
+    a[i++] = li->data;
+
+  merge_sort(a, a + lp->numitem, lp->numitem, cmp, reverse);
+
+  i = 0;
+  for (listitem* li = lp->first; li; li = li->next)
+    li->data = a[i++];
+  free(a);
 }
 
 void list_removeitem(list *lp, listitem *lip)
@@ -154,6 +172,23 @@ void list_removeitem(list *lp, listitem *lip)
   lp->numitem--;
 }
 
+/* moves LIP to the end of the list */
+void list_movelast(list *lp, listitem *lip)
+{
+  if (!lp || lp->last == lip)
+    return;
+
+  list_removeitem(lp, lip);
+  lip->next = NULL;
+  lip->prev = lp->last;
+  if (lp->last)
+    lp->last->next = lip;
+  else
+    lp->first = lip;
+  lp->last = lip;
+  lp->numitem++;
+}
+
 list *list_clone(list *lp, listclonefunc clonefunc)
 {
   if (!lp || !clonefunc)
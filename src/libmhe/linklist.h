@@ -44,6 +44,7 @@ void list_free(list *lp);
 void list_clear(list *lp);
 void list_delitem(list *lp, listitem *lip);
 void list_removeitem(list *lp, listitem *lip);
+void list_movelast(list *lp, listitem *lip);
 void list_additem(list *lp, void *data);
 size_t list_numitem(list *lp);
 listitem *list_search(list *lp, listsearchfunc cmpfunc, const void *arg);
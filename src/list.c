@@ -16,6 +16,7 @@
 #include "commands.h"
 #include "gvars.h"
 #include "utils.h"
+#include "ftpwalk.h"
 
 /* ls options */
 #define LS_LONG 1
@@ -89,8 +90,8 @@ static int print_filename(rfile *fi, unsigned opt, bool doclr)
 {
 	int len = 0;
 
-	if(doclr && fi->color)
-		printf("%s", fi->color);
+	if(doclr)
+		printf("%s", rfile_color(fi));
 	if(test(opt, LS_LITERAL))
 		len += printf("%s", base_name_ptr(fi->path));
 	else {
@@ -100,7 +101,7 @@ static int print_filename(rfile *fi, unsigned opt, bool doclr)
 		len += printf("%s", e);
 		free(e);
 	}
-	if(doclr && fi->color)
+	if(doclr)
 		printf("%s", endcolor());
 	if(test(opt, LS_CLASSIFY)) {
 		char cc = rfile_classchar(fi);
@@ -430,6 +431,8 @@ static void lsfiles(list *gl, unsigned opt)
 	else if(test(opt, LS_COLOR_ALWAYS))
 		doclr = true;
 
+	if(test(opt, LS_RECURSIVE))
+		ftp_walk_begin(gl);
 	ls_all(gl, opt, doclr);
 
 	if(test(opt, LS_RECURSIVE))
@@ -601,10 +604,10 @@ void cmd_ls(int argc, char **argv)
 						isdir = true;
 					else {
 						rf = ftp_get_file(q);
-						free(q);
 						if(rf && ftp_maybe_isdir(rf) == 1)
 							isdir = true;
 					}
+					free(q);
 				}
 			} else
 				/* prevent rglob_glob() from appending "*" */
@@ -20,6 +20,7 @@
 #include "commands.h"
 #include "lglob.h"
 #include "utils.h"
+#include "ftppool.h"
 
 #ifdef HAVE_REGEX_H
 # include <regex.h>
@@ -51,6 +52,30 @@ static bool put_owbatch = false;
 static bool put_delbatch = false;
 static bool put_quit = false;
 static bool put_skip_empty = false;
+static unsigned int put_parallel = 0;
+
+/* a file to put with --parallel */
+typedef struct put_job
+{
+	char *path;
+	char *dest;
+	putmode_t how;
+	unsigned opt;
+	mode_t mode;
+} put_job;
+
+/* a remote directory already made by put_mkpath() */
+typedef struct put_dir
+{
+	char *path;
+	bool created;  /* didn't exist before */
+} put_dir;
+
+/* lists of put_job and put_dir, collected by putfiles() when --parallel
+ * is given
+ */
+static list *put_jobs = 0;
+static list *put_dirs = 0;
 
 static char *put_glob_mask = 0;
 static char *put_dir_glob_mask = 0;
@@ -88,6 +113,7 @@ static void print_put_syntax(void)
 			"  -S, --stats[=NUM]    set stats transfer threshold; default is always\n"
 			"  -t, --tagged         transfer (locally) tagged file(s)\n"
 			"      --type=TYPE      specify transfer type, 'ascii' or 'binary'\n"
+			"      --parallel=N     put up to N files at once over N extra connections\n"
 			"  -v, --verbose        explain what is being done\n"
 			"  -u, --unique         store in unique filename (if server supports STOU)\n"));
 }
@@ -105,6 +131,26 @@ static bool put_exclude_func(char *path)
 	return false;
 }
 
+static transfer_mode_t put_transfer_type(const char *src, unsigned opt)
+{
+	if(test(opt, PUT_ASCII))
+		return tmAscii;
+	if(test(opt, PUT_BINARY))
+		return tmBinary;
+	return ascii_transfer(src) ? tmAscii : gvDefaultType;
+}
+
+static void put_report(const char *src, int r, unsigned opt)
+{
+	if(test(opt, PUT_NOHUP)) {
+		if(r == 0)
+			transfer_mail_msg(_("sent %s\n"), src);
+		else
+			transfer_mail_msg(_("failed to send %s: %s\n"),
+							  src, ftp_getreply(false));
+	}
+}
+
 static int do_the_put(const char *src, const char *dest,
 					  putmode_t how, unsigned opt)
 {
@@ -114,11 +160,7 @@ static int do_the_put(const char *src, const char *dest,
 	if(test(opt, PUT_NOHUP))
 		fprintf(stderr, "%s\n", src);
 
-	type = ascii_transfer(src) ? tmAscii : gvDefaultType;
-	if(test(opt, PUT_ASCII))
-		type = tmAscii;
-	else if(test(opt, PUT_BINARY))
-		type = tmBinary;
+	type = put_transfer_type(src, opt);
 
 #if 0 && (defined(HAVE_SETPROCTITLE) || defined(linux))
 	if(gvUseEnvString && ftp_connected())
@@ -131,17 +173,120 @@ static int do_the_put(const char *src, const char *dest,
 		setproctitle("%s", ftp->url->hostname);
 #endif
 
-	if(test(opt, PUT_NOHUP)) {
-		if(r == 0)
-			transfer_mail_msg(_("sent %s\n"), src);
-		else
-			transfer_mail_msg(_("failed to send %s: %s\n"),
-							  src, ftp_getreply(false));
+	put_report(src, r, opt);
+	return r;
+}
+
+/* finishes a successfully sent file: stats, --preserve and --delete-after
+ * DEST is the remote file actually written, or 0 if it isn't known
+ */
+static void putfile_done(const char *path, const char *dest, mode_t mode,
+						 unsigned opt, long long size)
+{
+	stats_file(STATS_SUCCESS, size);
+
+	if(test(opt, PUT_PRESERVE)) {
+		if(!dest)
+			ftp_trace("name of stored file not known, not preserving mode\n");
+		else if(ftp->has_site_chmod_command)
+			ftp_chmod(dest, get_mode_string(mode));
+	}
+
+	if(test(opt, PUT_DELETE_AFTER)) {
+		bool dodel = false;
+
+		char* sp = shortpath(path, 42, gvLocalHomeDir);
+		if(!test(opt, PUT_FORCE) && !put_delbatch) {
+			int a = ask(ASKYES|ASKNO|ASKCANCEL|ASKALL, ASKYES,
+						_("Delete local file '%s'?"), sp);
+			if(a == ASKALL) {
+				put_delbatch = true;
+				dodel = true;
+			}
+			else if(a == ASKCANCEL)
+				put_quit = true;
+			else if(a != ASKNO)
+				dodel = true;
+		} else
+			dodel = true;
+
+		if(dodel) {
+			if(unlink(path) == 0)
+				printf(_("%s: deleted\n"), sp);
+			else
+				printf(_("error deleting '%s': %s\n"), sp, strerror(errno));
+		}
+		free(sp);
 	}
+}
+
+static int put_dir_cmp(const put_dir *d, const char *path)
+{
+	return strcmp(d->path, path);
+}
+
+static int put_dir_destroy(put_dir *d)
+{
+	free(d->path);
+	free(d);
+	return 0;
+}
+
+/* makes sure remote directory PATH exists
+ * with --parallel each directory is made only once, while the files are
+ * collected and before any of them is sent
+ * returns -1 on failure, 1 if it was created, else 0
+ */
+static int put_mkpath(const char *path)
+{
+	char *q_path;
+	listitem *li;
+	put_dir *d;
+	int r;
+
+	if(put_dirs) {
+		/* files come a directory at a time, so try the last one first */
+		li = put_dirs->last;
+		if(!li || strcmp(((put_dir *)li->data)->path, path) != 0)
+			li = list_search(put_dirs, (listsearchfunc)put_dir_cmp, path);
+		if(li)
+			return ((put_dir *)li->data)->created ? 1 : 0;
+	}
+
+	q_path = backslash_quote(path);
+	r = ftp_mkpath(q_path);
+	free(q_path);
 
+	if(put_dirs && r != -1) {
+		d = xmalloc(sizeof(put_dir));
+		d->path = xstrdup(path);
+		d->created = (r == 1);
+		list_additem(put_dirs, d);
+	}
 	return r;
 }
 
+static void put_queue(const char *path, const char *dest, putmode_t how,
+					  unsigned opt, mode_t mode)
+{
+	put_job *job = xmalloc(sizeof(put_job));
+
+	job->path = xstrdup(path);
+	job->dest = xstrdup(dest);
+	job->how = how;
+	job->opt = opt;
+	job->mode = mode;
+	list_additem(put_jobs, job);
+}
+
+static int put_job_destroy(put_job *job)
+{
+	free(job->path);
+	free(job->dest);
+	free(job);
+	return 0;
+}
+
 static void putfile(const char *path, struct stat *sb,
 					unsigned opt, const char *output)
 {
@@ -150,7 +295,7 @@ static void putfile(const char *path, struct stat *sb,
 	char *dest, *dpath;
 	int r;
 	bool dir_created;
-	char *dest_dir, *q_dest_dir;
+	char *dest_dir;
 
 	if((put_glob_mask && fnmatch(put_glob_mask, base_name_ptr(path),
 								 FNM_EXTMATCH) == FNM_NOMATCH)
@@ -187,16 +332,16 @@ static void putfile(const char *path, struct stat *sb,
 	/* make sure destination directory exists */
 	dpath = base_dir_xptr(dest);
 	dest_dir = ftp_path_absolute(dpath);
-	q_dest_dir = backslash_quote(dest_dir);
-	r = ftp_mkpath(q_dest_dir);
-	free(q_dest_dir);
-	free(dest_dir);
+	r = put_mkpath(dest_dir);
 	if(r == -1) {
 		transfer_mail_msg(_("Couldn't create directory: %s\n"), dest_dir);
+		free(dest_dir);
 		free(dpath);
 		free(dest);
 		return;
 	}
+	free(dest_dir);
+	free(dpath);
 	dir_created = (r == 1);
 
 	if(!dir_created && !test(opt, PUT_UNIQUE) && !test(opt, PUT_FORCE)) {
@@ -282,47 +427,21 @@ static void putfile(const char *path, struct stat *sb,
   if(test(opt, PUT_TRY_UNIQUE))
     how = putTryUnique;
 
-	r = do_the_put(path, dest, how, opt);
-	free(dest);
-
-	if(r != 0) {
-		stats_file(STATS_FAIL, 0);
+	if(put_jobs) {
+		/* sent later by the worker pool */
+		put_queue(path, dest, how, opt, sb->st_mode);
+		free(dest);
 		return;
-	} else {
-		stats_file(STATS_SUCCESS, ftp->ti.total_size);
-	}
-
-	if(test(opt, PUT_PRESERVE)) {
-		if(ftp->has_site_chmod_command)
-			ftp_chmod(ftp->ti.local_name, get_mode_string(sb->st_mode));
 	}
 
-	if(test(opt, PUT_DELETE_AFTER)) {
-		bool dodel = false;
-
-		char* sp = shortpath(path, 42, gvLocalHomeDir);
-		if(!test(opt, PUT_FORCE) && !put_delbatch) {
-			int a = ask(ASKYES|ASKNO|ASKCANCEL|ASKALL, ASKYES,
-						_("Delete local file '%s'?"), sp);
-			if(a == ASKALL) {
-				put_delbatch = true;
-				dodel = true;
-			}
-			else if(a == ASKCANCEL)
-				put_quit = true;
-			else if(a != ASKNO)
-				dodel = true;
-		} else
-			dodel = true;
+	r = do_the_put(path, dest, how, opt);
+	free(dest);
 
-		if(dodel) {
-			if(unlink(path) == 0)
-				printf(_("%s: deleted\n"), sp);
-			else
-				printf(_("error deleting '%s': %s\n"), sp, strerror(errno));
-		}
-		free(sp);
-	}
+	if(r != 0)
+		stats_file(STATS_FAIL, 0);
+	else
+		putfile_done(path, ftp->ti.local_name, sb->st_mode, opt,
+					 ftp->ti.total_size);
 }
 
 static int put_sort_func(const void *a, const void *b)
@@ -461,6 +580,112 @@ static void putfiles(list *gl, unsigned opt, const char *output)
 	}
 }
 
+static int put_job_func(unsigned int n, void *data, ftp_transfer_func hookf)
+{
+	const put_job *job = ((put_job **)data)[n];
+
+	return ftp_putfile(job->path, job->dest, job->how,
+					   put_transfer_type(job->path, job->opt), hookf);
+}
+
+/* sends the files queued by putfiles() over a pool of put_parallel
+ * sessions, then finishes them here in the order they were queued
+ */
+static void put_run_jobs(unsigned opt)
+{
+	const unsigned int n = list_numitem(put_jobs);
+	unsigned int i = 0;
+	long long total_size = 0;
+	listitem *li;
+	char *name;
+
+	if(n == 0)
+		return;
+
+	put_job **jobs = xmalloc(n * sizeof(put_job *));
+	for(li = put_jobs->first; li; li = li->next) {
+		struct stat sb;
+		put_job *job = (put_job *)li->data;
+		jobs[i++] = job;
+		if(stat(job->path, &sb) == 0)
+			total_size += sb.st_size;
+	}
+
+	if (asprintf(&name, _("%u files"), n) == -1)
+	{
+		fprintf(stderr, _("Failed to allocate memory.\n"));
+		free(jobs);
+		return;
+	}
+
+	ftp_pool_result *res = ftp_pool_run(put_parallel, n, put_job_func, jobs,
+										name, name, total_size,
+										test(opt, PUT_VERBOSE)
+										&& !gvSighupReceived
+										&& !test(opt, PUT_NOHUP)
+										? transfer : 0);
+	if(!res)
+		ftp_trace("no worker sessions, putting files one at a time\n");
+
+	for(i = 0; i < n && !put_quit; i++) {
+		const put_job *job = jobs[i];
+
+		if(!res) {
+			/* no extra sessions could be opened */
+			if(gvInterrupted)
+				break;
+			if(do_the_put(job->path, job->dest, job->how, job->opt) == 0)
+				putfile_done(job->path, ftp->ti.local_name, job->mode,
+							 job->opt, ftp->ti.total_size);
+			else
+				stats_file(STATS_FAIL, 0);
+			continue;
+		}
+
+		if(res[i].status == FTP_POOL_NOTRUN)
+			continue;
+		stats_recovery(res[i].recoveries);
+		/* the worker changed the directory behind our back */
+		ftp_cache_flush_mark_for(job->dest);
+		put_report(job->path, res[i].status == FTP_POOL_OK ? 0 : -1, job->opt);
+		if(res[i].status == FTP_POOL_OK) {
+			/* with --unique, the server chose the name */
+			const char *dest = res[i].name;
+			if(!*dest)
+				dest = (job->how == putUnique ? 0 : job->dest);
+			putfile_done(job->path, dest, job->mode, job->opt,
+						 res[i].total_size);
+		}
+		else
+			stats_worker_file(STATS_FAIL, 0, res[i].worker);
+	}
+
+	free(res);
+	free(name);
+	free(jobs);
+}
+
+/* puts the files in GL, over a pool of sessions if --parallel is given */
+static void putfiles_all(list *gl, unsigned opt, const char *output)
+{
+	if(put_parallel > 1) {
+		put_jobs = list_new((listfunc)put_job_destroy);
+		put_dirs = list_new((listfunc)put_dir_destroy);
+	}
+
+	putfiles(gl, opt, output);
+	if(test(opt, PUT_TAGGED))
+		putfiles(gvLocalTagList, opt, output);
+
+	if(put_jobs) {
+		put_run_jobs(opt);
+		list_free(put_jobs);
+		list_free(put_dirs);
+		put_jobs = 0;
+		put_dirs = 0;
+	}
+}
+
 /* store a local file on remote server */
 void cmd_put(int argc, char **argv)
 {
@@ -502,6 +727,7 @@ void cmd_put(int argc, char **argv)
 		{"stats", optional_argument, 0, 'S'},
 		{"tagged", no_argument, 0, 't'},
 		{"type", required_argument, 0, '1'},
+		{"parallel", required_argument, 0, '5'},
 		{"verbose", no_argument, 0, 'v'},
 		{"unique", no_argument, 0, 'u'},
 		{"help", no_argument, 0, 'h'},
@@ -528,6 +754,7 @@ void cmd_put(int argc, char **argv)
 #endif
 
 	put_skip_empty = false;
+	put_parallel = 0;
 
   optind = 0; /* force getopt() to re-initialize */
   while((c = getopt_long(argc, argv,
@@ -649,6 +876,13 @@ void cmd_put(int argc, char **argv)
         return;
       }
       break;
+    case '5': /* --parallel=N */
+      put_parallel = parse_count(optarg, FTP_POOL_MAX_WORKERS);
+      if(put_parallel == 0) {
+        printf(_("Invalid option argument --parallel=%s\n"), optarg);
+        return;
+      }
+      break;
     case 'p':
       opt |= PUT_PRESERVE;
       break;
@@ -736,12 +970,10 @@ void cmd_put(int argc, char **argv)
 				opt |= PUT_TRY_UNIQUE;
 			opt |= PUT_FORCE;
 
-			putfiles(gl, opt, put_output);
+			putfiles_all(gl, opt, put_output);
 			list_free(gl);
-			if(test(opt, PUT_TAGGED)) {
-				putfiles(gvLocalTagList, opt, put_output);
+			if(test(opt, PUT_TAGGED))
 				list_clear(gvLocalTagList);
-			}
 			free(put_output);
 
 			transfer_end_nohup();
@@ -759,12 +991,10 @@ void cmd_put(int argc, char **argv)
 		exit(0);
 	}
 
-	putfiles(gl, opt, put_output);
+	putfiles_all(gl, opt, put_output);
 	list_free(gl);
-	if(test(opt, PUT_TAGGED)) {
-		putfiles(gvLocalTagList, opt, put_output);
+	if(test(opt, PUT_TAGGED))
 		list_clear(gvLocalTagList);
-	}
 	free(put_output);
 	gvInTransfer = false;
 
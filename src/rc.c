@@ -284,6 +284,10 @@ int parse_rc(const char *file, bool warn)
 			gvQuitOnEOF = nextbool(fp);
 		else if(strcasecmp(e, "use_passive_mode") == 0)
 			gvPasvmode = nextbool(fp);
+		else if(strcasecmp(e, "persistent_cache") == 0)
+			gvPersistentCache = nextbool(fp);
+		else if(strcasecmp(e, "server_glob") == 0)
+			gvServerGlob = nextbool(fp);
 		else if(strcasecmp(e, "use_history") == 0)
 			gvUseHistory = nextbool(fp);
 		else if(strcasecmp(e, "beep_after_long_command") == 0)
@@ -381,6 +385,26 @@ int parse_rc(const char *file, bool warn)
 					 gvCacheTimeout);
 				gvCacheTimeout = 0;
 			}
+		} else if(strcasecmp(e, "prefetch_sessions") == 0) {
+			NEXTSTR;
+			if(atoi(e) < 0) {
+				errp(_("Invalid value for prefetch_sessions: %s\n"), e);
+				gvPrefetchSessions = 0;
+			} else
+				gvPrefetchSessions = (unsigned)atoi(e);
+		} else if(strcasecmp(e, "cache_max_dirs") == 0) {
+			NEXTSTR;
+			if(atoi(e) < 0) {
+				errp(_("Invalid value for cache_max_dirs: %s\n"), e);
+				gvCacheMaxDirs = 0;
+			} else
+				gvCacheMaxDirs = (unsigned)atoi(e);
+		} else if(strcasecmp(e, "cache_max_memory") == 0) {
+			NEXTSTR;
+			if(!parse_size(e, &gvCacheMaxMemory)) {
+				errp(_("Invalid value for cache_max_memory: %s\n"), e);
+				gvCacheMaxMemory = 0;
+			}
 		} else if(strcasecmp(e, "connect_attempts") == 0) {
 			NEXTSTR;
 			gvConnectAttempts = (unsigned)atoi(e);
@@ -392,6 +416,19 @@ int parse_rc(const char *file, bool warn)
 		} else if(strcasecmp(e, "connection_timeout") == 0) {
 			NEXTSTR;
 			gvConnectionTimeout = (unsigned)atoi(e);
+		} else if(strcasecmp(e, "autotune_buffer_max") == 0) {
+			NEXTSTR;
+			if(atoi(e) < 0) {
+				errp(_("Invalid value for autotune_buffer_max: %s\n"), e);
+				gvAutotuneBufferMax = 0;
+			} else
+				gvAutotuneBufferMax = (unsigned)atoi(e);
+		} else if(strcasecmp(e, "stall_timeout") == 0) {
+			NEXTSTR;
+			gvStallTimeout = (unsigned)atoi(e);
+		} else if(strcasecmp(e, "stall_min_rate") == 0) {
+			NEXTSTR;
+			gvStallMinRate = (unsigned)atoi(e);
 		} else if(strcasecmp(e, "include") == 0) {
 			char *rcfile;
 			NEXTSTR;
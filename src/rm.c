@@ -17,6 +17,7 @@
 #include "strq.h"
 #include "input.h"
 #include "commands.h"
+#include "ftpwalk.h"
 
 #define RM_INTERACTIVE 1
 #define RM_FORCE 2
@@ -196,6 +197,8 @@ void cmd_rm(int argc, char **argv)
 	if(test(opt, RM_FORCE))
 		opt &= ~RM_INTERACTIVE;
 
+	if(test(opt, RM_RECURSIVE))
+		ftp_walk_begin(gl);
 	remove_files(gl, opt);
 	if(test(opt, RM_TAGGED)) {
 		remove_files(ftp->taglist, opt);
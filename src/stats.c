@@ -24,6 +24,7 @@ Stats *stats_create(void)
 
 void stats_destroy(Stats *stats)
 {
+	free(stats->worker_fail);
 	free(stats);
 }
 
@@ -32,7 +33,11 @@ void stats_reset(Stats *stats)
 	stats->success = 0;
 	stats->skip = 0;
 	stats->fail = 0;
+	stats->recovered = 0;
 	stats->size = 0;
+	free(stats->worker_fail);
+	stats->worker_fail = 0;
+	stats->workers = 0;
 }
 
 void stats_file(int type, uint64_t size)
@@ -46,6 +51,27 @@ void stats_file(int type, uint64_t size)
 	}
 }
 
+void stats_recovery(unsigned int count)
+{
+	gvStatsTransfer->recovered += count;
+}
+
+void stats_worker_file(int type, uint64_t size, unsigned int worker)
+{
+	stats_file(type, size);
+	if (type != STATS_FAIL) return;
+
+	if (worker >= gvStatsTransfer->workers) {
+		unsigned int i;
+		gvStatsTransfer->worker_fail = xrealloc(gvStatsTransfer->worker_fail,
+			(worker + 1) * sizeof(unsigned int));
+		for (i = gvStatsTransfer->workers; i <= worker; i++)
+			gvStatsTransfer->worker_fail[i] = 0;
+		gvStatsTransfer->workers = worker + 1;
+	}
+	gvStatsTransfer->worker_fail[worker]++;
+}
+
 void stats_display(Stats *s, unsigned int threshold)
 {
 	if ((s->success + s->skip + s->fail) < threshold) return;
@@ -57,6 +83,8 @@ void stats_display(Stats *s, unsigned int threshold)
 		printf(_("Skipped %u files, "), s->skip);
 	if (s->fail > 0)
 		printf(_("%u failures, "), s->fail);
+	if (s->recovered > 0)
+		printf(_("%u stalled transfers resumed, "), s->recovered);
 
 	if (s->size < 1024) {
 		printf(_("total size %lu bytes.\n\n"), s->size);
@@ -70,5 +98,14 @@ void stats_display(Stats *s, unsigned int threshold)
 		char *pf = "KMGTPEZY";
 		printf(_("total size %lu %ciB.\n\n"), size, pf[i]);
 	}
+
+	if (s->workers > 0) {
+		unsigned int i;
+		printf(_("Failures by worker:"));
+		for (i = 0; i < s->workers; i++)
+			if (s->worker_fail[i] > 0)
+				printf(" #%u: %u", i + 1, s->worker_fail[i]);
+		printf("\n\n");
+	}
 }
 
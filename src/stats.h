@@ -20,7 +20,10 @@ typedef struct Stats
 	unsigned int success;
 	unsigned int skip;
 	unsigned int fail;
+	unsigned int recovered;     /* stalled transfers resumed */
   uint64_t size;
+	unsigned int workers;       /* size of worker_fail */
+	unsigned int *worker_fail;  /* failures per parallel worker */
 	
 } Stats;
 
@@ -39,11 +42,21 @@ void stats_reset(Stats *stats);
 **/
 void stats_file(int type, uint64_t size);
 
+/**
+* Same as stats_file, for a file transferred by parallel worker number WORKER.
+**/
+void stats_worker_file(int type, uint64_t size, unsigned int worker);
+
 #define STATS_SUCCESS 1
 #define STATS_SKIP 2
 #define STATS_FAIL 3
 
 
+/**
+* Called for each stalled transfer that was reconnected and resumed.
+**/
+void stats_recovery(unsigned int count);
+
 /**
 * Display stats
 **/
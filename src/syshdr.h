@@ -109,6 +109,15 @@
 #ifdef HAVE_FCNTL_H
 # include <fcntl.h>
 #endif
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+# include <sys/sendfile.h>
+#endif
 
 /* networking headers */
 #ifdef HAVE_SYS_SOCKET_H
@@ -126,6 +135,9 @@
 #ifdef HAVE_NETINET_IP_H
 # include <netinet/ip.h> /* for IPTOS_* */
 #endif
+#ifdef HAVE_NETINET_TCP_H
+# include <netinet/tcp.h> /* for TCP_INFO */
+#endif
 #ifdef HAVE_ARPA_INET_H
 # include <arpa/inet.h> /* for inet_aton() or inet_addr()  */
 #endif
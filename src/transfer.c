@@ -262,6 +262,14 @@ void transfer(transfer_info *ti)
 			printf(_("transfer interrupted\n"));
 		else if(ti->ioerror)
 			printf(_("transfer I/O error\n"));
+		if(gvAutotuneBufferMax && ti->chunk_size) {
+			printf(_("buffers: %sB reads/writes"), human_size(ti->chunk_size));
+			if(ti->sockbuf_size > 0)
+				printf(_(", %sB socket buffers"), human_size(ti->sockbuf_size));
+			if(ti->rtt > 0)
+				printf(_(", rtt %.2f ms"), ti->rtt / 1000.0);
+			printf("\n");
+		}
 	}
 
 	if(ti->size > ti->total_size)
@@ -236,3 +236,48 @@ void invoke_shell(const char* fmt, ...)
 	}
 	waitpid(pid, 0, 0);  /* wait for child to finish execution */
 }
+
+unsigned int parse_count(const char *str, unsigned int max)
+{
+	char *e;
+
+	/* strtoul() takes "-1" as ULONG_MAX */
+	while(isspace((unsigned char)*str))
+		str++;
+	if(!isdigit((unsigned char)*str))
+		return 0;
+
+	errno = 0;
+	const unsigned long n = strtoul(str, &e, 10);
+	if(errno != 0 || *e != 0 || n < 1 || n > max)
+		return 0;
+	return (unsigned int)n;
+}
+
+bool parse_size(const char *str, size_t *size)
+{
+	char *e;
+	unsigned long long scale = 1;
+
+	while(isspace((unsigned char)*str))
+		str++;
+	if(!isdigit((unsigned char)*str))
+		return false;
+
+	errno = 0;
+	const unsigned long long n = strtoull(str, &e, 10);
+	if(errno != 0)
+		return false;
+	if(*e == 'k' || *e == 'K')
+		scale = 1024;
+	else if(*e == 'm' || *e == 'M')
+		scale = 1024 * 1024;
+	else if(*e == 'g' || *e == 'G')
+		scale = 1024 * 1024 * 1024;
+	if(scale != 1)
+		e++;
+	if(*e != 0 || n > SIZE_MAX / scale)
+		return false;
+	*size = (size_t)(n * scale);
+	return true;
+}
@@ -31,4 +31,11 @@ void invoke_shell(const char* fmt, ...) YAFC_PRINTF(1, 2);
 /* Create directory recursively */
 bool make_path(const char* path);
 
+/* Parse a number from 1 to MAX, returns 0 if STR isn't one */
+unsigned int parse_count(const char *str, unsigned int max);
+
+/* Parse a number of bytes, with an optional k, M or G suffix, into *SIZE;
+ * returns false if STR isn't one or it doesn't fit */
+bool parse_size(const char *str, size_t *size);
+
 #endif